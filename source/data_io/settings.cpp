@@ -68,8 +68,14 @@ void load_settings() {
 	             std::max(COMMUNITY_IMAGE_SIZE_MIN, load_int("community_image_size", COMMUNITY_IMAGE_SIZE_DEFAULT)));
 	var_autoplay_level = std::min(2, std::max(0, load_int("autoplay_level", 2)));
 	var_loop_mode = std::min(2, std::max(0, load_int("loop_mode", 0)));
-	var_video_quality = std::min(480, std::max(0, load_int("video_quality", var_is_new3ds ? 360 : 144)));
+	var_video_quality = std::min(480, std::max(VIDEO_QUALITY_AUTO, load_int("video_quality", var_is_new3ds ? 360 : 144)));
 	var_forward_buffer_ratio = std::max(0.1, std::min(1.0, load_double("forward_buffer_ratio", 0.8)));
+	var_buffer_target_seconds = std::max(10.0, std::min(300.0, load_double("buffer_target_seconds", 60.0)));
+	var_buffer_low_water_seconds =
+	    std::max(5.0, std::min(var_buffer_target_seconds, load_double("buffer_low_water_seconds", 20.0)));
+	var_stream_cache_size_mb = std::max(0, std::min(2048, load_int("stream_cache_size_mb", 256)));
+	var_livestream_prefetch_fragments = std::max(1, std::min(8, load_int("livestream_prefetch_fragments", 3)));
+	var_livestream_low_latency_fragments = std::max(0, std::min(4, load_int("livestream_low_latency_fragments", 0)));
 	var_history_enabled = load_int("history_enabled", 1);
 	var_video_show_debug_info = load_int("video_show_debug_info", 0);
 	var_player_response = load_int("player_response", 1); // (Beta 24.1, switch to Android VR for now)
@@ -119,6 +125,11 @@ void save_settings() {
 	add_int("loop_mode", var_loop_mode);
 	add_int("video_quality", var_video_quality);
 	add_double("forward_buffer_ratio", var_forward_buffer_ratio);
+	add_double("buffer_target_seconds", var_buffer_target_seconds);
+	add_double("buffer_low_water_seconds", var_buffer_low_water_seconds);
+	add_int("stream_cache_size_mb", var_stream_cache_size_mb);
+	add_int("livestream_prefetch_fragments", var_livestream_prefetch_fragments);
+	add_int("livestream_low_latency_fragments", var_livestream_low_latency_fragments);
 	add_int("history_enabled", var_history_enabled);
 	add_int("video_show_debug_info", var_video_show_debug_info);
 	add_int("player_response", var_player_response);
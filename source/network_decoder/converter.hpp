@@ -19,5 +19,3 @@ Result_with_string Util_converter_bgr888_rotate_90_degree(u8 *bgr888, u8 **rotat
 
 Result_with_string Util_converter_bgr888_to_yuv420p(u8 *bgr888, u8 **yuv420p, int width, int height);
 
-Result_with_string Util_converter_y2r_yuv420p_to_bgr565(u8 *yuv420p, u8 **bgr565, int width, int height,
-                                                        bool texture_format);
@@ -1,30 +1,44 @@
 #include "headers.hpp"
-
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image/stb_image.h"
 
-// returns in BGR565 format, should be freed
-u8 *Image_decode(u8 *input, size_t input_len, int *width, int *height) {
+static void pack_rgb888(const u8 *rgb, int pixel_num, bool rgba8, u8 *out) {
+	if (rgba8) {
+		u32 *out_head = (u32 *)out;
+		for (int i = 0; i < pixel_num * 3; i += 3) {
+			*out_head++ = (u32)rgb[i + 0] << 24 | (u32)rgb[i + 1] << 16 | (u32)rgb[i + 2] << 8 | 0xFF;
+		}
+	} else {
+		u16 *out_head = (u16 *)out;
+		for (int i = 0; i < pixel_num * 3; i += 3) {
+			u16 r = rgb[i + 0];
+			u16 g = rgb[i + 1];
+			u16 b = rgb[i + 2];
+			*out_head++ = ((r & 0b11111000) << 8) | ((g & 0b11111100) << 3) | (b >> 3);
+		}
+	}
+}
+
+static u8 *decode_full(u8 *input, size_t input_len, bool rgba8, int *width, int *height) {
 	int image_ch = 0;
 	u8 *rgb_image = stbi_load_from_memory(input, input_len, width, height, &image_ch, STBI_rgb);
 	if (!rgb_image) {
 		logger.error("image-dec", "stbi load failed : " + std::string(stbi_failure_reason()));
 		return NULL;
 	}
-	u8 *bgr_image = (u8 *)malloc(*width * *height * 2);
-	if (!bgr_image) {
-		stbi_image_free(rgb_image);
-		return NULL;
-	}
-	int in_size = *width * *height * 3;
-	u16 *out_head = (u16 *)bgr_image;
-	for (int i = 0; i < in_size; i += 3) {
-		u16 r = rgb_image[i + 0];
-		u16 g = rgb_image[i + 1];
-		u16 b = rgb_image[i + 2];
-		*out_head++ = ((r & 0b11111000) << 8) | ((g & 0b11111100) << 3) | (b >> 3);
+	u8 *res = (u8 *)malloc(*width * *height * (rgba8 ? 4 : 2));
+	if (res) {
+		pack_rgb888(rgb_image, *width * *height, rgba8, res);
 	}
-
 	stbi_image_free(rgb_image);
-	return bgr_image;
+	return res;
+}
+
+// returns in BGR565 format, should be freed
+u8 *Image_decode(u8 *input, size_t input_len, int *width, int *height) {
+	return decode_full(input, input_len, false, width, height);
+}
+// returns in RGBA8 with opaque alpha, should be freed
+u8 *Image_decode_rgba8(u8 *input, size_t input_len, int *width, int *height) {
+	return decode_full(input, input_len, true, width, height);
 }
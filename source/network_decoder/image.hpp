@@ -1,3 +1,4 @@
 #pragma once
 
 u8 *Image_decode(u8 *input, size_t input_len, int *width, int *height);
+u8 *Image_decode_rgba8(u8 *input, size_t input_len, int *width, int *height);
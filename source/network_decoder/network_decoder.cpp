@@ -5,6 +5,57 @@
 
 extern "C" void memcpy_asm(u8 *, u8 *, int);
 
+/* --------------------------------------------------------- */
+/*                  packet pool, allocation stats            */
+/* --------------------------------------------------------- */
+// more than the packets held at once by the packet buffers and a prepared video switch
+#define PACKET_POOL_MAX 256
+static Mutex packet_pool_lock; // guards `alloc_stats` as well
+static std::vector<AVPacket *> packet_pool;
+static NetworkDecoderAllocStats alloc_stats;
+
+AVPacket *network_decoder_packet_alloc() {
+	AVPacket *res = NULL;
+	packet_pool_lock.lock();
+	if (packet_pool.size()) {
+		res = packet_pool.back();
+		packet_pool.pop_back();
+		alloc_stats.packet_reuse_num++;
+	}
+	packet_pool_lock.unlock();
+	if (!res) {
+		res = av_packet_alloc();
+		packet_pool_lock.lock();
+		alloc_stats.packet_alloc_num++;
+		packet_pool_lock.unlock();
+	}
+	return res;
+}
+void network_decoder_packet_free(AVPacket **packet) {
+	if (!*packet) {
+		return;
+	}
+	av_packet_unref(*packet);
+	packet_pool_lock.lock();
+	if (packet_pool.size() < PACKET_POOL_MAX) {
+		packet_pool.push_back(*packet);
+		*packet = NULL;
+	}
+	packet_pool_lock.unlock();
+	av_packet_free(packet); // no-op if it has been pooled
+}
+NetworkDecoderAllocStats network_decoder_get_alloc_stats() {
+	packet_pool_lock.lock();
+	NetworkDecoderAllocStats res = alloc_stats;
+	packet_pool_lock.unlock();
+	return res;
+}
+static void count_decoder_alloc(u64 NetworkDecoderAllocStats::*counter) {
+	packet_pool_lock.lock();
+	alloc_stats.*counter += 1;
+	packet_pool_lock.unlock();
+}
+
 /* --------------------------------------------------------- */
 /*                  NetworkDecoderFFmpegIOData               */
 /* --------------------------------------------------------- */
@@ -26,6 +77,8 @@ void NetworkDecoderFFmpegIOData::deinit(bool deinit_stream) {
 		deinit_(type, deinit_stream);
 	}
 }
+// the stream is signaled when data comes, this only bounds the time to notice an interrupt or a quit request
+#define STREAM_WAIT_MS 50
 static int read_network_stream(void *opaque, u8 *buf, int buf_size_) { // size or AVERROR_EOF
 	NetworkDecoder *decoder = ((std::pair<NetworkDecoder *, NetworkStream *> *)opaque)->first;
 	NetworkStream *stream = ((std::pair<NetworkDecoder *, NetworkStream *> *)opaque)->second;
@@ -34,8 +87,11 @@ static int read_network_stream(void *opaque, u8 *buf, int buf_size_) { // size o
 	// Util_log_save("dec", "read " + std::to_string(stream->read_head) + " " + std::to_string(buf_size_) + " " +
 	// std::to_string(stream->len));
 	bool cpu_limited = false;
-	while (!stream->ready ||
-	       !stream->is_data_available(stream->read_head, std::min<u64>(buf_size, stream->len - stream->read_head))) {
+	if (stream->ready && stream->read_head == stream->len) {
+		return AVERROR_EOF;
+	}
+	// a short read is fine for FFmpeg, so only wait until the first byte is available
+	while (!stream->ready || !stream->is_data_available(stream->read_head, 1)) {
 		if (stream->ready && stream->read_head >= stream->len) {
 			logger.error("dec",
 			             "read beyond eof : " + std::to_string(stream->read_head) + " " + std::to_string(stream->len));
@@ -46,12 +102,16 @@ static int read_network_stream(void *opaque, u8 *buf, int buf_size_) { // size o
 			decoder->need_reinit = true;
 			goto fail;
 		}
+		if (!stream->network_waiting_status && decoder->ready && !decoder->seeking &&
+		    decoder->is_stream_played(stream)) {
+			decoder->stall_num++;
+		}
 		stream->network_waiting_status = "Reading stream";
 		if (!cpu_limited) {
 			cpu_limited = true;
 			add_cpu_limit(ADDITIONAL_CPU_LIMIT);
 		}
-		usleep(20000);
+		stream->wait_for_data(STREAM_WAIT_MS);
 		if (stream->error || stream->quit_request) {
 			// show the error message only once per stream
 			if (!stream->read_dead_tried) {
@@ -68,10 +128,8 @@ static int read_network_stream(void *opaque, u8 *buf, int buf_size_) { // size o
 	stream->network_waiting_status = NULL;
 
 	{
-		auto tmp = stream->get_data(stream->read_head, std::min<u64>(buf_size, stream->len - stream->read_head));
-		size_t read_size = tmp.size();
-		stream->read_head += read_size;
-		memcpy(buf, &tmp[0], read_size);
+		size_t read_size = stream->read_data(stream->read_head, buf_size, buf);
+		stream->set_read_head(stream->read_head + read_size);
 		if (!read_size) {
 			return AVERROR_EOF;
 		}
@@ -94,7 +152,7 @@ static int64_t seek_network_stream(void *opaque, s64 offset, int whence) { // si
 
 	while (!stream->ready) {
 		stream->network_waiting_status = "Reading stream (init, seek)";
-		usleep(20000);
+		stream->wait_for_data(STREAM_WAIT_MS);
 		if (stream->error || stream->quit_request) {
 			stream->network_waiting_status = NULL;
 			return -1;
@@ -122,7 +180,7 @@ static int64_t seek_network_stream(void *opaque, s64 offset, int whence) { // si
 		return -1;
 	}
 
-	stream->read_head = new_pos;
+	stream->set_read_head(new_pos);
 
 	return stream->read_head;
 }
@@ -140,7 +198,7 @@ Result_with_string NetworkDecoderFFmpegIOData::init_(int type, NetworkDecoder *p
 	Result_with_string result;
 	int ffmpeg_result;
 
-	network_stream[type]->read_head = 0;
+	network_stream[type]->set_read_head(0);
 
 	opaque[type] = new std::pair<NetworkDecoder *, NetworkStream *>(parent_decoder, network_stream[type]);
 	unsigned char *buffer = (unsigned char *)av_malloc(NETWORK_BUFFER_SIZE);
@@ -198,6 +256,7 @@ Result_with_string NetworkDecoderFFmpegIOData::init_(int type, NetworkDecoder *p
 			}
 		}
 	}
+	update_time_index(type);
 	return result;
 
 fail:
@@ -205,6 +264,45 @@ fail:
 	result.string = DEF_ERR_FFMPEG_RETURNED_NOT_SUCCESS_STR;
 	return result;
 }
+void NetworkDecoderFFmpegIOData::update_time_index(int type) {
+	NetworkStream *stream = network_stream[type];
+	if (!stream || stream->whole_download || !format_context[type]) {
+		return;
+	}
+	// WebM has the whole index (Cues) after the header, while for fragmented mp4 the entries are added as we go
+	int index = video_audio_separate        ? stream_index[type]
+	            : stream_index[VIDEO] != -1 ? stream_index[VIDEO]
+	                                        : stream_index[AUDIO];
+	if (index < 0) {
+		return;
+	}
+	AVStream *av_stream = format_context[type]->streams[index];
+	double time_base = av_q2d(av_stream->time_base);
+	std::vector<std::pair<u64, double>> entries;
+	int entry_num = avformat_index_get_entries_count(av_stream);
+	for (int i = 0; i < entry_num; i++) {
+		const AVIndexEntry *entry = avformat_index_get_entry(av_stream, i);
+		if (entry && entry->timestamp != AV_NOPTS_VALUE && entry->pos >= 0) {
+			entries.push_back({(u64)entry->pos, entry->timestamp * time_base});
+		}
+	}
+	double duration = format_context[type]->duration != AV_NOPTS_VALUE
+	                      ? (double)format_context[type]->duration / AV_TIME_BASE
+	                      : -1;
+	stream->set_time_index(duration, std::move(entries));
+}
+void NetworkDecoderFFmpegIOData::replace_video(NetworkDecoderFFmpegIOData &new_io) {
+	deinit_(VIDEO, true);
+	network_stream[VIDEO] = new_io.network_stream[VIDEO];
+	opaque[VIDEO] = new_io.opaque[VIDEO];
+	format_context[VIDEO] = new_io.format_context[VIDEO];
+	io_context[VIDEO] = new_io.io_context[VIDEO];
+	stream_index[VIDEO] = new_io.stream_index[VIDEO];
+	new_io.network_stream[VIDEO] = NULL;
+	new_io.opaque[VIDEO] = NULL;
+	new_io.format_context[VIDEO] = NULL;
+	new_io.io_context[VIDEO] = NULL;
+}
 #define RETURN_WITH_PREFIX_ON_ERROR(exp, prefix)                                                                       \
 	do {                                                                                                               \
 		if ((result = exp).code != 0) {                                                                                \
@@ -265,7 +363,7 @@ Result_with_string NetworkDecoderFFmpegIOData::reinit_stream(int type, int64_t s
 	}
 
 	// the dts of the first packet read from the new format_context should be equal to seek_timestamp
-	test_packet = av_packet_alloc();
+	test_packet = network_decoder_packet_alloc();
 	ffmpeg_result = av_read_frame(format_context[type], test_packet);
 	if (ffmpeg_result != 0) {
 		result.error_description = "av_read_frame() failed : " + std::to_string(ffmpeg_result);
@@ -284,7 +382,7 @@ ffmpeg_fail:
 	result.string = DEF_ERR_FFMPEG_RETURNED_NOT_SUCCESS_STR;
 
 end:
-	av_packet_free(&test_packet);
+	network_decoder_packet_free(&test_packet);
 	return result;
 }
 double NetworkDecoderFFmpegIOData::get_duration() {
@@ -541,7 +639,7 @@ void NetworkDecoder::deinit() {
 
 	for (int type = 0; type < 2; type++) {
 		for (auto i : packet_buffer[type]) {
-			av_packet_free(&i);
+			network_decoder_packet_free(&i);
 		}
 		packet_buffer[type].clear();
 	}
@@ -556,8 +654,8 @@ void NetworkDecoder::deinit() {
 	for (auto i : video_tmp_frames.deinit()) {
 		av_frame_free(&i);
 	}
-	free(sw_video_output_tmp);
-	sw_video_output_tmp = NULL;
+	sw_video_frame_held = false;
+	av_frame_free(&audio_tmp_frame);
 
 	// its members should be freed by NetworkMultipleDecoder, not here
 	// just to prevent use-after-free, we set the pointer to NULL
@@ -620,12 +718,7 @@ Result_with_string NetworkDecoder::init_output_buffer(bool is_mvd) {
 			}
 		}
 		video_tmp_frames.init(init);
-
-		sw_video_output_tmp = (u8 *)malloc(width * height * 1.5);
-		if (!sw_video_output_tmp) {
-			result.error_description = "malloc() failed while preallocating ";
-			goto fail;
-		}
+		sw_video_frame_held = false;
 	}
 
 	return result;
@@ -742,18 +835,22 @@ Result_with_string NetworkDecoder::init(bool request_hw_decoder) {
 	}
 
 	mvd_first = true;
+	stall_num = 0;
 	ready = true;
 	return result;
 }
 void NetworkDecoder::clear_buffer() {
 	for (int type = 0; type < 2; type++) {
 		for (auto i : packet_buffer[type]) {
-			av_packet_free(&i);
+			network_decoder_packet_free(&i);
 		}
 		packet_buffer[type].clear();
 	}
 	video_mvd_tmp_frames.clear();
-	video_tmp_frames.clear();
+	for (; !video_tmp_frames.empty(); video_tmp_frames.pop()) {
+		av_frame_unref(video_tmp_frames.get_next_poped());
+	}
+	sw_video_frame_held = false;
 	buffered_pts_list.clear();
 }
 
@@ -809,16 +906,27 @@ std::vector<std::pair<double, std::vector<double>>> NetworkDecoder::get_bufferin
 	critical_op_lock.unlock();
 	return res;
 }
+void NetworkDecoder::set_prefetch_times(const std::vector<double> &times) {
+	critical_op_lock.lock();
+	if (ready) {
+		for (int type = 0; type < 2; type++) {
+			if (io->network_stream[type] && !io->network_stream[type]->quit_request) {
+				io->network_stream[type]->set_prefetch_times(times);
+			}
+		}
+	}
+	critical_op_lock.unlock();
+}
 
 Result_with_string NetworkDecoder::read_packet(int type) {
 	Result_with_string result;
 	int ffmpeg_result;
 
-	AVPacket *tmp_packet = av_packet_alloc();
+	AVPacket *tmp_packet = network_decoder_packet_alloc();
 	if (!tmp_packet) {
 		result.code = DEF_ERR_OUT_OF_MEMORY;
 		result.string = DEF_ERR_OUT_OF_MEMORY_STR;
-		result.error_description = "av_packet_alloc() failed";
+		result.error_description = "network_decoder_packet_alloc() failed";
 		return result;
 	}
 
@@ -855,7 +963,7 @@ Result_with_string NetworkDecoder::read_packet(int type) {
 	}
 
 ffmpeg_fail:
-	av_packet_free(&tmp_packet);
+	network_decoder_packet_free(&tmp_packet);
 	result.code = DEF_ERR_FFMPEG_RETURNED_NOT_SUCCESS;
 	result.string = DEF_ERR_FFMPEG_RETURNED_NOT_SUCCESS_STR;
 	return result;
@@ -1030,7 +1138,7 @@ Result_with_string NetworkDecoder::mvd_decode(int *width, int *height) {
 	mvd_first = false;
 	linearFree_concurrent(mvd_packet);
 	mvd_packet = NULL;
-	av_packet_free(&packet_read);
+	network_decoder_packet_free(&packet_read);
 	packet_buffer[VIDEO].pop_front();
 	// refill the packet buffer
 	while (!packet_buffer[VIDEO].size() && read_packet(is_av_separate() ? VIDEO : BOTH).code == 0)
@@ -1075,21 +1183,7 @@ Result_with_string NetworkDecoder::decode_video(int *width, int *height, bool *k
 		if (ffmpeg_result == 0) {
 			*width = cur_frame->width;
 			*height = cur_frame->height;
-
-			double time_base = av_q2d(get_stream(VIDEO)->time_base);
-			double cur_pos;
-			if (cur_frame->pts != AV_NOPTS_VALUE) {
-				cur_pos = cur_frame->pts * time_base;
-			} else {
-				cur_pos = cur_frame->pkt_dts * time_base;
-			}
-			cur_pos += timestamp_offset;
-
-			buffered_pts_list_lock.lock();
-			buffered_pts_list.insert(cur_pos);
-			buffered_pts_list_lock.unlock();
-
-			video_tmp_frames.push();
+			push_decoded_video_frame(cur_frame);
 		} else if (ffmpeg_result == AVERROR(EAGAIN)) {
 			result.code = DEF_ERR_NEED_MORE_INPUT;
 		} else {
@@ -1103,7 +1197,7 @@ Result_with_string NetworkDecoder::decode_video(int *width, int *height, bool *k
 		result.error_description = "avcodec_send_packet() failed " + std::to_string(ffmpeg_result);
 	}
 
-	av_packet_free(&packet_read);
+	network_decoder_packet_free(&packet_read);
 	packet_buffer[VIDEO].pop_front();
 	// refill the packet buffer
 	while (!packet_buffer[VIDEO].size() && read_packet(is_av_separate() ? VIDEO : BOTH).code == 0)
@@ -1111,7 +1205,23 @@ Result_with_string NetworkDecoder::decode_video(int *width, int *height, bool *k
 
 	return result;
 }
-Result_with_string NetworkDecoder::decode_audio(int *size, u8 **data, double *cur_pos) {
+void NetworkDecoder::push_decoded_video_frame(AVFrame *frame) {
+	double time_base = av_q2d(get_stream(VIDEO)->time_base);
+	double cur_pos;
+	if (frame->pts != AV_NOPTS_VALUE) {
+		cur_pos = frame->pts * time_base;
+	} else {
+		cur_pos = frame->pkt_dts * time_base;
+	}
+	cur_pos += timestamp_offset;
+
+	buffered_pts_list_lock.lock();
+	buffered_pts_list.insert(cur_pos);
+	buffered_pts_list_lock.unlock();
+
+	video_tmp_frames.push();
+}
+Result_with_string NetworkDecoder::decode_audio(int *size, double *cur_pos) {
 	int ffmpeg_result = 0;
 	Result_with_string result;
 	*size = 0;
@@ -1123,7 +1233,11 @@ Result_with_string NetworkDecoder::decode_audio(int *size, u8 **data, double *cu
 
 	AVPacket *packet_read = packet_buffer[AUDIO][0];
 
-	AVFrame *cur_frame = av_frame_alloc();
+	if (!audio_tmp_frame) {
+		audio_tmp_frame = av_frame_alloc();
+		count_decoder_alloc(&NetworkDecoderAllocStats::audio_frame_alloc_num);
+	}
+	AVFrame *cur_frame = audio_tmp_frame;
 	if (!cur_frame) {
 		result.error_description = "av_frame_alloc() failed";
 		goto ffmpeg_fail;
@@ -1137,10 +1251,8 @@ Result_with_string NetworkDecoder::decode_audio(int *size, u8 **data, double *cu
 			if (result.code != 0) {
 				goto cleanup;
 			}
-			auto out_frame = filter.output_frame;
-			*data = (u8 *)malloc(out_frame->nb_samples * 2 * decoder_context[AUDIO]->channels);
-			*size = 2 * swr_convert(swr_context, data, out_frame->nb_samples, (const u8 **)out_frame->data,
-			                        out_frame->nb_samples);
+			// converted later by output_decoded_audio(), straight into the buffer of the speaker
+			*size = 2 * filter.output_frame->nb_samples;
 			*cur_pos += timestamp_offset;
 		} else {
 			result.error_description = "avcodec_receive_frame() failed " + std::to_string(ffmpeg_result);
@@ -1158,15 +1270,22 @@ ffmpeg_fail:
 	result.string = DEF_ERR_FFMPEG_RETURNED_NOT_SUCCESS_STR;
 
 cleanup:
-	av_packet_free(&packet_read);
+	network_decoder_packet_free(&packet_read);
 	packet_buffer[AUDIO].pop_front();
 	while (!packet_buffer[AUDIO].size() && read_packet(is_av_separate() ? AUDIO : BOTH).code == 0)
 		;
-	av_frame_free(&cur_frame);
+	if (cur_frame) {
+		av_frame_unref(cur_frame);
+	}
 	return result;
 }
+int NetworkDecoder::output_decoded_audio(u8 *data) {
+	auto out_frame = filter.output_frame;
+	return 2 * swr_convert(swr_context, &data, out_frame->nb_samples, (const u8 **)out_frame->data,
+	                       out_frame->nb_samples);
+}
 
-Result_with_string NetworkDecoder::get_decoded_video_frame(int width, int height, u8 **data, double *cur_pos) {
+Result_with_string NetworkDecoder::get_decoded_video_frame(u8 **data, AVFrame **frame, double *cur_pos) {
 	Result_with_string result;
 
 	if (hw_decoder_enabled) {
@@ -1181,26 +1300,10 @@ Result_with_string NetworkDecoder::get_decoded_video_frame(int width, int height
 			result.code = DEF_ERR_NEED_MORE_INPUT;
 			return result;
 		}
-		AVFrame *cur_frame = video_tmp_frames.get_next_poped();
-		video_tmp_frames.pop();
-
-		int cpy_size[2] = {
-		    0,
-		    0,
-		};
-
-		cpy_size[0] = (width * height);
-		cpy_size[1] = cpy_size[0] / 4;
-		cpy_size[0] -= cpy_size[0] % 32;
-		cpy_size[1] -= cpy_size[1] % 32;
-
-		memcpy_asm(sw_video_output_tmp, cur_frame->data[0], cpy_size[0]);
-		memcpy_asm(sw_video_output_tmp + (width * height), cur_frame->data[1], cpy_size[1]);
-		memcpy_asm(sw_video_output_tmp + (width * height) + (width * height / 4), cur_frame->data[2], cpy_size[1]);
-
-		*data = sw_video_output_tmp;
-
-		av_frame_unref(cur_frame);
+		my_assert(!sw_video_frame_held);
+		// the frame keeps its slot in video_tmp_frames until it's released, so the decoder never writes to it meanwhile
+		*frame = video_tmp_frames.get_next_poped();
+		sw_video_frame_held = true;
 	}
 
 	buffered_pts_list_lock.lock();
@@ -1211,11 +1314,112 @@ Result_with_string NetworkDecoder::get_decoded_video_frame(int width, int height
 
 	return result;
 }
+void NetworkDecoder::release_decoded_video_frame() {
+	if (!sw_video_frame_held) {
+		return;
+	}
+	av_frame_unref(video_tmp_frames.get_next_poped());
+	video_tmp_frames.pop();
+	sw_video_frame_held = false;
+}
+void NetworkDecoder::discard_decoded_video_frame() {
+	u8 *data;
+	AVFrame *frame;
+	double pos;
+	if (get_decoded_video_frame(&data, &frame, &pos).code == 0) {
+		release_decoded_video_frame();
+	}
+}
+
+double NetworkDecoder::get_next_video_packet_time() {
+	if (packet_buffer[VIDEO].empty()) {
+		return -1;
+	}
+	AVPacket *packet = packet_buffer[VIDEO][0];
+	return (packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts) * av_q2d(get_stream(VIDEO)->time_base) +
+	       timestamp_offset;
+}
+Result_with_string NetworkDecoder::flush_video_decoder() {
+	Result_with_string result;
+	if (hw_decoder_enabled) { // the hardware decoder outputs a frame for every packet
+		return result;
+	}
 
+	avcodec_send_packet(decoder_context[VIDEO], NULL); // returns AVERROR_EOF from the second call, which is fine
+	while (true) {
+		if (video_tmp_frames.full()) {
+			result.code = DEF_ERR_NEED_MORE_OUTPUT;
+			return result;
+		}
+		AVFrame *cur_frame = video_tmp_frames.get_next_pushed();
+		if (avcodec_receive_frame(decoder_context[VIDEO], cur_frame) != 0) {
+			break; // AVERROR_EOF : all the frames are out
+		}
+		push_decoded_video_frame(cur_frame);
+	}
+	return result;
+}
+Result_with_string NetworkDecoder::change_video_stream(NetworkDecoderFFmpegIOData &new_video_io,
+                                                       const std::deque<AVPacket *> &packets,
+                                                       bool request_hw_decoder) {
+	Result_with_string result;
+
+	critical_op_lock.lock();
+	io->replace_video(new_video_io);
+
+	for (auto i : packet_buffer[VIDEO]) {
+		network_decoder_packet_free(&i);
+	}
+	packet_buffer[VIDEO] = packets;
+	// the output buffer depends on the resolution and on the decoder
+	for (auto i : video_mvd_tmp_frames.deinit()) {
+		free(i);
+	}
+	linearFree_concurrent(mvd_frame);
+	mvd_frame = NULL;
+	for (auto i : video_tmp_frames.deinit()) {
+		av_frame_free(&i);
+	}
+	sw_video_frame_held = false;
+	buffered_pts_list_lock.lock();
+	buffered_pts_list.clear();
+	buffered_pts_list_lock.unlock();
+	avcodec_free_context(&decoder_context[VIDEO]);
+
+	hw_decoder_enabled = request_hw_decoder;
+	mvd_first = true;
+	result = init_decoder(VIDEO);
+	if (result.code != 0) {
+		result.error_description = "[v] " + result.error_description;
+	} else {
+		result = init_output_buffer(request_hw_decoder);
+		if (result.code != 0) {
+			result.error_description = "[out buf] " + result.error_description;
+		}
+	}
+	if (result.code != 0) {
+		ready = false; // can't go on with the video stream half-initialized
+	}
+	stall_num = 0; // the stalls of the previous quality say nothing about the new one
+	critical_op_lock.unlock();
+	return result;
+}
 Result_with_string NetworkDecoder::seek(s64 microseconds) {
+	// waits for the network in here are expected, so they are not counted as stalls
+	seeking = true;
+	Result_with_string result = seek_(microseconds);
+	seeking = false;
+	return result;
+}
+Result_with_string NetworkDecoder::seek_(s64 microseconds) {
 	Result_with_string result;
 
 	clear_buffer();
+	// the index may have grown since the last update (fragmented mp4)
+	io->update_time_index(VIDEO);
+	if (is_av_separate()) {
+		io->update_time_index(AUDIO);
+	}
 
 	s64 min_ts = std::max<s64>(0, microseconds - 1000000);
 	s64 max_ts = microseconds + 500000;
@@ -1257,9 +1461,7 @@ Result_with_string NetworkDecoder::seek(s64 microseconds) {
 				continue;
 			} else if (result.code == DEF_ERR_NEED_MORE_OUTPUT) {
 				// buffer is full
-				u8 *buf;
-				double pos;
-				get_decoded_video_frame(width, height, &buf, &pos);
+				discard_decoded_video_frame();
 				continue;
 			} else if (result.code != 0) {
 				break;
@@ -1279,9 +1481,7 @@ Result_with_string NetworkDecoder::seek(s64 microseconds) {
 				break;
 			}
 
-			u8 *buf;
-			double pos;
-			get_decoded_video_frame(width, height, &buf, &pos);
+			discard_decoded_video_frame();
 		}
 
 		// once successfully sought on video, perform an exact seek on audio
@@ -1331,7 +1531,7 @@ Result_with_string NetworkDecoder::seek(s64 microseconds) {
 			pts *= audio_time_base;
 
 			if (pts * 1000000 < microseconds - 50000) { // Keep if within 50ms of target
-				av_packet_free(&pkt);
+				network_decoder_packet_free(&pkt);
 				packet_buffer[AUDIO].pop_front();
 				if (packet_buffer[AUDIO].empty()) {
 					read_packet(AUDIO);
@@ -1385,9 +1585,7 @@ Result_with_string NetworkDecoder::seek(s64 microseconds) {
 			} else if (result.code == DEF_ERR_NEED_MORE_OUTPUT) {
 				// buffer is full, but we haven't reached the target timestamp yet
 				// so pop the frame and discard it
-				u8 *buf;
-				double pos;
-				get_decoded_video_frame(width, height, &buf, &pos);
+				discard_decoded_video_frame();
 				continue;
 			} else if (result.code != 0) {
 				break;
@@ -1410,9 +1608,7 @@ Result_with_string NetworkDecoder::seek(s64 microseconds) {
 			}
 
 			// discard the frame
-			u8 *buf;
-			double pos;
-			get_decoded_video_frame(width, height, &buf, &pos);
+			discard_decoded_video_frame();
 		}
 	}
 
@@ -1429,7 +1625,7 @@ Result_with_string NetworkDecoder::seek(s64 microseconds) {
 			// But if pts is significantly before target, drop it.
 			// Be conservative.
 			if (pts * 1000000 < microseconds - 100000) { // 100ms grace period
-				av_packet_free(&pkt);
+				network_decoder_packet_free(&pkt);
 				packet_buffer[AUDIO].pop_front();
 			} else {
 				break;
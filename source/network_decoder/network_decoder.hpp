@@ -19,6 +19,20 @@ extern "C" {
 #include "libavutil/log.h"
 }
 
+// AVPackets are recycled instead of being allocated for every packet read
+// only the structs are kept, their payload is still allocated by libavformat and released when they are freed
+AVPacket *network_decoder_packet_alloc();
+// unreferences the payload and keeps the struct for the next network_decoder_packet_alloc(), `*packet` becomes NULL
+void network_decoder_packet_free(AVPacket **packet);
+
+// the numbers of heap allocations made by the decoders, to verify that the playback itself makes none once started
+struct NetworkDecoderAllocStats {
+	u64 packet_alloc_num = 0;  // AVPacket structs newly allocated
+	u64 packet_reuse_num = 0;  // AVPacket structs taken back from the pool
+	u64 audio_frame_alloc_num = 0;
+};
+NetworkDecoderAllocStats network_decoder_get_alloc_stats();
+
 namespace network_decoder_ {
 /*
     internal queue used to buffer the raw output of decoded images
@@ -113,6 +127,10 @@ class NetworkDecoderFFmpegIOData {
 	void deinit(bool deinit_stream);
 	Result_with_string reinit();
 	Result_with_string reinit_stream(int type, int64_t seek_timestamp);
+	// passes the byte offset -> time mapping in the index the demuxer has built so far to the downloader
+	void update_time_index(int type);
+	// deinits the video stream and takes over the one of `new_io` (which is left without a video stream)
+	void replace_video(NetworkDecoderFFmpegIOData &new_io);
 	double get_duration();
 };
 
@@ -165,7 +183,8 @@ class NetworkDecoder {
 	network_decoder_::output_buffer<AVFrame *> video_tmp_frames;
 	network_decoder_::output_buffer<u8 *> video_mvd_tmp_frames;
 	u8 *mvd_frame = NULL; // internal buffer written directly by the mvd service
-	u8 *sw_video_output_tmp = NULL;
+	bool sw_video_frame_held = false; // the oldest frame of video_tmp_frames is being used by the caller
+	AVFrame *audio_tmp_frame = NULL; // reused for every audio frame decoded
 	Mutex buffered_pts_list_lock;            // lock of buffered_pts_list
 	std::multiset<double> buffered_pts_list; // used for HW decoder to determine the pts when outputting a frame
 	bool mvd_first = false;
@@ -176,6 +195,9 @@ class NetworkDecoder {
 	Result_with_string init_decoder(int type);
 	Result_with_string read_packet(int type);
 	Result_with_string mvd_decode(int *width, int *height);
+	Result_with_string seek_(s64 microseconds);
+	void push_decoded_video_frame(AVFrame *frame);
+	void discard_decoded_video_frame();
 	AVStream *get_stream(int type) {
 		return io->format_context[is_av_separate() ? type : BOTH]->streams[io->stream_index[type]];
 	}
@@ -185,6 +207,12 @@ class NetworkDecoder {
 	volatile bool interrupt = false;
 	volatile bool need_reinit = false;
 	volatile bool ready = false;
+	volatile bool seeking = false;
+	volatile int stall_num = 0; // the number of times the playback had to wait for the network (seeks not included)
+	// whether `stream` is being played, as opposed to the one prebuffered for a video switch or a fragment fetched ahead
+	bool is_stream_played(const NetworkStream *stream) {
+		return io && (io->network_stream[VIDEO] == stream || io->network_stream[AUDIO] == stream);
+	}
 	volatile bool avformat_reinit_request[2] = {false, false};
 	double timestamp_offset = 0;
 	bool frame_cores_enabled[4];
@@ -209,6 +237,8 @@ class NetworkDecoder {
 		return res;
 	}
 	std::vector<std::pair<double, std::vector<double>>> get_buffering_progress_bars(int bar_len);
+	// see NetworkStream::set_prefetch_times()
+	void set_prefetch_times(const std::vector<double> &times);
 
 	size_t get_raw_buffer_num() { return hw_decoder_enabled ? video_mvd_tmp_frames.size() : video_tmp_frames.size(); }
 	size_t get_raw_buffer_num_max() {
@@ -287,14 +317,31 @@ class NetworkDecoder {
 	Result_with_string decode_video(int *width, int *height, bool *key_frame);
 
 	// decode the previously read audio packet
-	// if return.code == 0, *data is a malloced pointer and should be freed
-	// otherwise, *data is untouched
-	Result_with_string decode_audio(int *size, u8 **data, double *cur_pos);
-
-	// get the previously decoded video frame raw data
-	// the pointer stored in *data should NOT be freed
-	Result_with_string get_decoded_video_frame(int width, int height, u8 **data, double *cur_pos);
+	// if return.code == 0, *size is the size of the PCM per channel in bytes, to be written by output_decoded_audio()
+	// otherwise, *size is 0
+	Result_with_string decode_audio(int *size, double *cur_pos);
+	// converts the audio frame decoded by the last decode_audio() into interleaved 16-bit PCM written to `data`,
+	// which must have room for the size it returned, and returns the size actually written per channel
+	int output_decoded_audio(u8 *data);
+
+	// get the previously decoded video frame
+	// HW decoder : *data receives the BGR565 image, which should NOT be freed
+	// SW decoder : *frame receives the YUV420P frame itself, which stays valid until release_decoded_video_frame()
+	Result_with_string get_decoded_video_frame(u8 **data, AVFrame **frame, double *cur_pos);
+	// gives the frame got by get_decoded_video_frame() back to the decoder, must be called before getting the next one
+	void release_decoded_video_frame();
 
 	// seek both audio and video
 	Result_with_string seek(s64 microseconds);
+
+	// the following are used to switch the video stream while playing (e.g. to another quality) keeping the audio
+	// the decoding timestamp in seconds of the next video packet, or -1 if there is none
+	double get_next_video_packet_time();
+	// moves the frames left inside the video decoder to the output buffer, DEF_ERR_NEED_MORE_OUTPUT if it gets full
+	Result_with_string flush_video_decoder();
+	// replaces the video stream with the one of `new_video_io` and reinitializes the video decoder and the output
+	// buffer, `packets` are the first packets of the new stream starting with a keyframe (owned by the decoder after
+	// this call) the converter must not touch the decoder while this is running
+	Result_with_string change_video_stream(NetworkDecoderFFmpegIOData &new_video_io,
+	                                       const std::deque<AVPacket *> &packets, bool request_hw_decoder);
 };
@@ -10,6 +10,12 @@ void NetworkMultipleDecoder::deinit() {
 
 	inited = false;
 
+	video_switch_lock.lock();
+	discard_video_switch();
+	video_switch_id++;
+	prefetch_times.clear();
+	video_switch_lock.unlock();
+
 	decoder.deinit();
 	decoder.deinit_filter();
 	for (auto &i : fragments) {
@@ -72,6 +78,11 @@ Result_with_string NetworkMultipleDecoder::init(std::string video_url, std::stri
 	this->fragment_len = fragment_len;
 	this->downloader = &downloader;
 	error_count.clear();
+	fragment_latency_ms = fragment_latency_avg_ms = 0;
+	low_latency_fragments = is_livestream ? var_livestream_low_latency_fragments : 0;
+	live_catching_up = false;
+	live_latency = -1;
+	decoder.filter.tempo_request = user_tempo; // in case the previous livestream ended while catching up
 	this->adjust_timestamp = adjust_timestamp;
 
 	if (request_hw_decoder) {
@@ -90,7 +101,10 @@ Result_with_string NetworkMultipleDecoder::init(std::string video_url, std::stri
 		return url.substr(0, erase_start) + url.substr(erase_end, url.size());
 	};
 
-	std::string url_append = !is_livestream ? "" : fragment_len == 1 ? "&headm=4" : "&headm=2";
+	std::string url_append = !is_livestream             ? ""
+	                         : low_latency_fragments != 0 ? "&headm=" + std::to_string(low_latency_fragments)
+	                         : fragment_len == 1          ? "&headm=4"
+	                                                      : "&headm=2";
 	int fragment_id = 0;
 	NetworkDecoderFFmpegIOData tmp_ffmpeg_data;
 	std::vector<NetworkStream *> streams;
@@ -99,6 +113,9 @@ Result_with_string NetworkMultipleDecoder::init(std::string video_url, std::stri
 		    new NetworkStream(video_url + url_append, extract_stream_length(video_url), is_livestream, NULL);
 		NetworkStream *audio_stream =
 		    new NetworkStream(audio_url + url_append, extract_stream_length(audio_url), is_livestream, NULL);
+		if (!is_livestream) {
+			video_stream->cache_video_id = audio_stream->cache_video_id = cache_video_id;
+		}
 		streams = {video_stream, audio_stream};
 		downloader.add_stream(video_stream);
 		downloader.add_stream(audio_stream);
@@ -114,6 +131,9 @@ Result_with_string NetworkMultipleDecoder::init(std::string video_url, std::stri
 	} else {
 		NetworkStream *both_stream =
 		    new NetworkStream(both_url + url_append, extract_stream_length(both_url), is_livestream, NULL);
+		if (!is_livestream) {
+			both_stream->cache_video_id = cache_video_id;
+		}
 		streams = {both_stream};
 		downloader.add_stream(both_stream);
 		decoder.interrupt = false;
@@ -181,6 +201,35 @@ void NetworkMultipleDecoder::check_filter_update() {
 	}
 }
 
+void NetworkMultipleDecoder::apply_tempo() {
+	decoder.filter.tempo_request = user_tempo * (live_catching_up ? LIVE_CATCH_UP_TEMPO : 1.0);
+	filter_update_request = true;
+}
+void NetworkMultipleDecoder::update_live_latency(double cur_pos) {
+	if (!inited || !is_livestream) {
+		return;
+	}
+	double latency = std::max(0.0, get_duration() - cur_pos);
+	live_latency = latency;
+	if (!low_latency_fragments) {
+		return;
+	}
+	double target = get_live_target_latency();
+	bool catching_up = live_catching_up;
+	if (latency > target + fragment_len && latency < target + LIVE_CATCH_UP_MAX_SECONDS) {
+		catching_up = true;
+	} else if (latency <= target || latency >= target + LIVE_CATCH_UP_MAX_SECONDS) {
+		catching_up = false;
+	}
+	if (catching_up != live_catching_up) {
+		// each change rebuilds the audio filter, hence the hysteresis of one fragment
+		live_catching_up = catching_up;
+		apply_tempo();
+		logger.info("net/mul-dec", std::string(catching_up ? "catching up" : "caught up") +
+		                               " with the live edge, latency : " + std::to_string(latency) + " s");
+	}
+}
+
 NetworkMultipleDecoder::PacketType NetworkMultipleDecoder::next_decode_type() {
 	PacketType res = decoder.next_decode_type();
 	if (res == PacketType::EoF) {
@@ -220,6 +269,15 @@ void NetworkMultipleDecoder::recalc_buffered_head() {
 	}
 	seq_buffered_head = res;
 }
+void NetworkMultipleDecoder::set_prefetch_times(const std::vector<double> &times) {
+	if (is_livestream) {
+		return;
+	}
+	video_switch_lock.lock(); // the video stream may be replaced by a switch
+	prefetch_times = times;
+	video_switch_lock.unlock();
+	decoder.set_prefetch_times(times);
+}
 std::vector<std::pair<double, std::vector<double>>> NetworkMultipleDecoder::get_buffering_progress_bars(int bar_len) {
 	if (!inited || !decoder.ready) {
 		return {};
@@ -274,6 +332,17 @@ Result_with_string NetworkMultipleDecoder::seek(s64 microseconds) {
 		decoder.change_ffmpeg_io_data(fragments[(int)seq_using], adjust_timestamp ? seq_using * fragment_len : 0);
 		fragments_lock.unlock();
 	} else {
+		// the prepared video stream starts at a keyframe near the old position, so prepare it again for the new one
+		video_switch_lock.lock();
+		bool video_switch_pending =
+		    video_switch_state != VideoSwitchState::NONE && video_switch_state != VideoSwitchState::FAILED;
+		std::string video_switch_url_bak = video_switch_url;
+		bool video_switch_hw_decoder_bak = video_switch_hw_decoder;
+		video_switch_lock.unlock();
+		if (video_switch_pending) {
+			request_video_switch(video_switch_url_bak, video_switch_hw_decoder_bak, microseconds / 1000000.0);
+		}
+
 		decoder.clear_buffer();
 		// flush data buffered inside the filter
 		decoder.deinit_filter();
@@ -287,8 +356,196 @@ Result_with_string NetworkMultipleDecoder::seek(s64 microseconds) {
 	return result;
 }
 
+void NetworkMultipleDecoder::request_video_switch(std::string video_url, bool request_hw_decoder, double cur_pos) {
+	video_switch_lock.lock();
+	discard_video_switch();
+	video_switch_id++;
+	video_switch_url = video_url;
+	video_switch_hw_decoder = request_hw_decoder;
+	video_switch_pos = cur_pos;
+	video_switch_state = VideoSwitchState::REQUESTED;
+	video_switch_lock.unlock();
+}
+void NetworkMultipleDecoder::discard_video_switch() {
+	if (video_switch_state == VideoSwitchState::READY) {
+		video_switch_io.deinit_(VIDEO, true);
+		for (auto i : video_switch_packets) {
+			network_decoder_packet_free(&i);
+		}
+		video_switch_packets.clear();
+	}
+	// if it's being prepared, the initer thread will notice the change of video_switch_id and discard it
+	video_switch_state = VideoSwitchState::NONE;
+}
+void NetworkMultipleDecoder::prepare_video_switch() {
+	video_switch_lock.lock();
+	int id = video_switch_id;
+	std::string url = video_switch_url;
+	bool request_hw_decoder = video_switch_hw_decoder;
+	double target_pos = video_switch_pos + VIDEO_SWITCH_LEAD_SECONDS;
+	video_switch_state = VideoSwitchState::PREPARING;
+	video_switch_lock.unlock();
+
+	logger.info("net/mul-dec", "preparing the video switch at " + std::to_string(target_pos));
+	if (request_hw_decoder) {
+		init_mvd();
+		request_hw_decoder = mvd_inited;
+	}
+
+	Result_with_string result;
+	NetworkDecoderFFmpegIOData new_io;
+	std::deque<AVPacket *> packets;
+	double switch_time = 0;
+
+	NetworkStream *stream = new NetworkStream(url, extract_stream_length(url), false, NULL);
+	stream->disable_interrupt = true; // interrupts (seeks etc.) are for the streams being played
+	stream->cache_video_id = cache_video_id;
+	downloader->add_stream(stream);
+	new_io.video_audio_separate = true;
+	new_io.network_stream[VIDEO] = stream;
+	new_io.parent_decoder = &decoder;
+	result = new_io.init_(VIDEO, &decoder);
+	if (result.code == 0) {
+		AVFormatContext *format_context = new_io.format_context[VIDEO];
+		double time_base = av_q2d(format_context->streams[new_io.stream_index[VIDEO]]->time_base);
+		s64 target_ts = target_pos * AV_TIME_BASE;
+		// the first keyframe at or after the target
+		int ffmpeg_result =
+		    avformat_seek_file(format_context, -1, target_ts, target_ts, std::numeric_limits<s64>::max(), 0);
+		if (ffmpeg_result < 0) {
+			result.code = DEF_ERR_FFMPEG_RETURNED_NOT_SUCCESS;
+			result.error_description = "avformat_seek_file() failed " + std::to_string(ffmpeg_result);
+		}
+		// read the packets to be decoded first, which also makes the downloader fetch the data from there
+		while (result.code == 0 && !initer_stop_request && !initer_exit_request) {
+			AVPacket *packet = network_decoder_packet_alloc();
+			if (!packet || av_read_frame(format_context, packet) != 0) {
+				network_decoder_packet_free(&packet);
+				break;
+			}
+			double time = (packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts) * time_base;
+			if (packets.empty()) {
+				if (!(packet->flags & AV_PKT_FLAG_KEY)) {
+					network_decoder_packet_free(&packet);
+					continue;
+				}
+				switch_time = time;
+			}
+			packets.push_back(packet);
+			if (time >= switch_time + VIDEO_SWITCH_PREBUFFER_SECONDS) {
+				break;
+			}
+		}
+		if (result.code == 0 && packets.empty()) {
+			result.code = -1;
+			result.error_description = "no keyframe after the switching point";
+		}
+	}
+
+	bool stopped = initer_stop_request || initer_exit_request;
+	video_switch_lock.lock();
+	if (id == video_switch_id && result.code == 0 && !stopped) {
+		stream->disable_interrupt = false;
+		video_switch_io = new_io;
+		video_switch_packets = packets;
+		video_switch_time = switch_time;
+		video_switch_hw_decoder = request_hw_decoder;
+		video_switch_state = VideoSwitchState::READY;
+		logger.info("net/mul-dec", "video switch ready at " + std::to_string(switch_time));
+	} else {
+		new_io.deinit_(VIDEO, true);
+		for (auto i : packets) {
+			network_decoder_packet_free(&i);
+		}
+		// otherwise, it has been requested again or canceled while preparing
+		if (id == video_switch_id && !stopped) {
+			logger.error("net/mul-dec", "video switch failed : " + result.error_description);
+			video_switch_state = VideoSwitchState::FAILED;
+		}
+	}
+	video_switch_lock.unlock();
+}
+bool NetworkMultipleDecoder::is_video_switch_ready() {
+	if (video_switch_state != VideoSwitchState::READY) {
+		return false;
+	}
+	double next_time = decoder.get_next_video_packet_time();
+	if (next_time < 0 || next_time < video_switch_time - 0.001) {
+		return false;
+	}
+	if (next_time > video_switch_time + 0.5) { // the decoder went past the switching point while preparing
+		video_switch_lock.lock();
+		std::string url = video_switch_url;
+		bool request_hw_decoder = video_switch_hw_decoder;
+		video_switch_lock.unlock();
+		request_video_switch(url, request_hw_decoder, next_time);
+		return false;
+	}
+	// the streams of different qualities normally have keyframes at the same positions, so this is one of them
+	return true;
+}
+bool NetworkMultipleDecoder::check_video_switch_failed() {
+	video_switch_lock.lock();
+	bool res = video_switch_state == VideoSwitchState::FAILED;
+	if (res) {
+		video_switch_state = VideoSwitchState::NONE;
+	}
+	video_switch_lock.unlock();
+	return res;
+}
+Result_with_string NetworkMultipleDecoder::apply_video_switch() {
+	video_switch_lock.lock();
+	Result_with_string result =
+	    decoder.change_video_stream(video_switch_io, video_switch_packets, video_switch_hw_decoder);
+	video_switch_packets.clear();
+	video_url = video_switch_url;
+	video_switch_state = VideoSwitchState::NONE;
+	std::vector<double> cur_prefetch_times = prefetch_times;
+	video_switch_lock.unlock();
+	decoder.set_prefetch_times(cur_prefetch_times); // for the new video stream
+	logger.info("net/mul-dec", "video switched at " + std::to_string(video_switch_time));
+	return result;
+}
+
+void NetworkMultipleDecoder::issue_fragment(int seq) {
+	PendingFragment fragment;
+	std::string url_prefix = "&sq=" + std::to_string(seq);
+	if (video_audio_separate) {
+		fragment.video_stream =
+		    new NetworkStream(video_url + url_prefix, extract_stream_length(video_url), is_livestream, NULL);
+		fragment.audio_stream =
+		    new NetworkStream(audio_url + url_prefix, extract_stream_length(audio_url), is_livestream, NULL);
+		fragment.video_stream->disable_interrupt = fragment.audio_stream->disable_interrupt = true;
+		downloader->add_stream(fragment.video_stream);
+		downloader->add_stream(fragment.audio_stream);
+	} else {
+		fragment.audio_stream =
+		    new NetworkStream(both_url + url_prefix, extract_stream_length(both_url), is_livestream, NULL);
+		fragment.audio_stream->disable_interrupt = true;
+		downloader->add_stream(fragment.audio_stream);
+	}
+	osTickCounterStart(&fragment.issued_time);
+	pending_fragments[seq] = fragment;
+}
+void NetworkMultipleDecoder::release_pending_fragment(int seq) {
+	auto itr = pending_fragments.find(seq);
+	if (itr == pending_fragments.end()) {
+		return;
+	}
+	if (itr->second.video_stream) {
+		itr->second.video_stream->quit_request = true;
+	}
+	itr->second.audio_stream->quit_request = true;
+	pending_fragments.erase(itr);
+}
+
 void NetworkMultipleDecoder::livestream_initer_thread_func() {
 	while (!initer_exit_request) {
+		if (initer_stop_request) {
+			while (pending_fragments.size()) {
+				release_pending_fragment(pending_fragments.begin()->first);
+			}
+		}
 		while (initer_stop_request && !initer_exit_request) {
 			initer_stopping = true;
 			usleep(10000);
@@ -298,6 +555,10 @@ void NetworkMultipleDecoder::livestream_initer_thread_func() {
 		}
 		initer_stopping = false;
 
+		if (inited && video_switch_state == VideoSwitchState::REQUESTED) {
+			prepare_video_switch();
+			continue;
+		}
 		if (!inited || !is_livestream) {
 			usleep(10000);
 			continue;
@@ -307,22 +568,38 @@ void NetworkMultipleDecoder::livestream_initer_thread_func() {
 		while (fragments.count(seq_next)) {
 			seq_next++;
 		}
-		if (seq_next - seq_using >= MAX_CACHE_FRAGMENTS_NUM || seq_next >= seq_num) {
+		// the fragments that will not be used anymore (after a seek, or beyond the end of the livestream)
+		int seq_window_end = std::min(seq_using + MAX_CACHE_FRAGMENTS_NUM, (int)seq_num);
+		std::vector<int> unused_fragments;
+		for (auto &fragment : pending_fragments) {
+			if (fragment.first < seq_using || fragment.first >= seq_window_end) {
+				unused_fragments.push_back(fragment.first);
+			}
+		}
+		for (auto seq : unused_fragments) {
+			release_pending_fragment(seq);
+		}
+		if (seq_next >= seq_window_end) {
 			usleep(10000);
 			continue;
 		}
+		// download ahead, in parallel with the initialization of the demuxer of the fragment needed first
+		// (but not beyond the latest fragment available, which would only fail)
+		int seq_fetch_end = std::min(seq_next + std::max(var_livestream_prefetch_fragments, 1), seq_window_end);
+		seq_fetch_end = std::max(seq_next + 1, std::min(seq_fetch_end, seq_head + 1));
+		for (int seq = seq_next; seq < seq_fetch_end; seq++) {
+			if (!fragments.count(seq) && !pending_fragments.count(seq)) {
+				issue_fragment(seq);
+			}
+		}
 		logger.info("net/live-init", "next : " + std::to_string(seq_next));
 
+		PendingFragment cur_fragment = pending_fragments[seq_next];
+		pending_fragments.erase(seq_next); // the streams are now either released or owned by `tmp_ffmpeg_data`
 		NetworkDecoderFFmpegIOData tmp_ffmpeg_data;
-		std::string url_prefix = "&sq=" + std::to_string(seq_next);
 		if (video_audio_separate) {
-			NetworkStream *video_stream =
-			    new NetworkStream(video_url + url_prefix, extract_stream_length(video_url), is_livestream, NULL);
-			NetworkStream *audio_stream =
-			    new NetworkStream(audio_url + url_prefix, extract_stream_length(audio_url), is_livestream, NULL);
-			video_stream->disable_interrupt = audio_stream->disable_interrupt = true;
-			downloader->add_stream(video_stream);
-			downloader->add_stream(audio_stream);
+			NetworkStream *video_stream = cur_fragment.video_stream;
+			NetworkStream *audio_stream = cur_fragment.audio_stream;
 
 			Result_with_string result = tmp_ffmpeg_data.init(video_stream, audio_stream, &decoder);
 			// Util_log_save("debug", "init finish");
@@ -358,10 +635,7 @@ void NetworkMultipleDecoder::livestream_initer_thread_func() {
 			}
 			video_stream->disable_interrupt = audio_stream->disable_interrupt = false;
 		} else {
-			NetworkStream *both_stream =
-			    new NetworkStream(both_url + url_prefix, extract_stream_length(both_url), is_livestream, NULL);
-			both_stream->disable_interrupt = true;
-			downloader->add_stream(both_stream);
+			NetworkStream *both_stream = cur_fragment.audio_stream;
 			Result_with_string result = tmp_ffmpeg_data.init(both_stream, &decoder);
 			if (result.code == 0) {
 				if (both_stream->seq_head != -1) {
@@ -403,7 +677,20 @@ void NetworkMultipleDecoder::livestream_initer_thread_func() {
 		recalc_buffered_head();
 		fragments_lock.unlock();
 
-		logger.info("net/live-init", "finish : " + std::to_string(seq_next));
+		constexpr double FRAGMENT_LATENCY_EWMA_WEIGHT = 0.2; // the weight of the newest fragment
+		osTickCounterUpdate(&cur_fragment.issued_time);
+		fragment_latency_ms = osTickCounterRead(&cur_fragment.issued_time);
+		if (fragment_latency_avg_ms == 0) {
+			fragment_latency_avg_ms = fragment_latency_ms;
+		} else {
+			fragment_latency_avg_ms = FRAGMENT_LATENCY_EWMA_WEIGHT * fragment_latency_ms +
+			                          (1 - FRAGMENT_LATENCY_EWMA_WEIGHT) * fragment_latency_avg_ms;
+		}
+		logger.info("net/live-init", "finish : " + std::to_string(seq_next) + " (" +
+		                                 std::to_string((int)fragment_latency_ms) + " ms since issued)");
+	}
+	while (pending_fragments.size()) {
+		release_pending_fragment(pending_fragments.begin()->first);
 	}
 	initer_stopping = true;
 }
@@ -11,6 +11,7 @@ class NetworkMultipleDecoder {
   private:
 	static constexpr int MAX_CACHE_FRAGMENTS_NUM = 10;
 	static constexpr int MAX_LIVESTREAM_RETRY = 2;
+	static constexpr int VIDEO = 0;
 	volatile bool initer_stop_request = true;
 	volatile bool initer_exit_request = false;
 	volatile bool initer_stopping = false;
@@ -27,6 +28,8 @@ class NetworkMultipleDecoder {
 	std::string video_url;
 	std::string audio_url;
 	std::string both_url;
+	std::string cache_video_id; // the streams are cached on the SD card under this id, "" not to cache
+	std::vector<double> prefetch_times; // guarded by `video_switch_lock`
 
 	NetworkDecoder decoder;
 	Mutex fragments_lock;
@@ -44,14 +47,66 @@ class NetworkMultipleDecoder {
 	volatile double duration_first_fragment =
 	    0; // for some reason, the first fragment of a livestream differs in length from other fragments
 
+	// livestream fragments being downloaded ahead, not given to the demuxer yet (only used by the initer thread)
+	// up to var_livestream_prefetch_fragments of them are downloaded in parallel, while the demuxer of the earliest one
+	// is initialized
+	struct PendingFragment {
+		NetworkStream *video_stream = NULL; // NULL if the video and the audio are in one stream
+		NetworkStream *audio_stream = NULL; // or the stream of both
+		TickCounter issued_time;
+	};
+	std::map<int, PendingFragment> pending_fragments;
+	// the time from issuing the download of a fragment until its demuxer is ready
+	volatile double fragment_latency_ms = 0;
+	volatile double fragment_latency_avg_ms = 0; // exponentially weighted moving average
+
+	void issue_fragment(int seq);
+	void release_pending_fragment(int seq);
+
+	// low-latency livestream mode : it starts near the live edge and the playback is sped up a little while it is more
+	// than a fragment behind its target latency
+	static constexpr double LIVE_CATCH_UP_TEMPO = 1.1;
+	// further behind than this, the user is considered to be watching the past on purpose (e.g. after a seek)
+	static constexpr double LIVE_CATCH_UP_MAX_SECONDS = 30.0;
+	int low_latency_fragments = 0; // the target latency in fragments, 0 if the mode is disabled (decided at init())
+	double user_tempo = 1.0;       // the tempo set by the user, the catch-up tempo is applied on top of it
+	bool live_catching_up = false;
+	volatile double live_latency = -1; // seconds behind the live edge, -1 if unknown
+	void apply_tempo();
+
 	void check_filter_update();
 	void recalc_buffered_head();
 
+	// switching the video stream while playing, with the audio stream and its cache left as they are
+	// the new stream is opened and prebuffered by the initer thread, and spliced in by the decoding thread
+	static constexpr double VIDEO_SWITCH_LEAD_SECONDS = 3.0; // how far ahead of the current position to splice it
+	static constexpr double VIDEO_SWITCH_PREBUFFER_SECONDS = 1.0;
+	enum class VideoSwitchState {
+		NONE,
+		REQUESTED,
+		PREPARING,
+		READY,
+		FAILED,
+	};
+	Mutex video_switch_lock;
+	volatile VideoSwitchState video_switch_state = VideoSwitchState::NONE;
+	int video_switch_id = 0; // incremented on every request, to tell whether a prepared stream is still wanted
+	std::string video_switch_url;
+	bool video_switch_hw_decoder = false;
+	double video_switch_pos = 0;
+	double video_switch_time = 0; // the decoding time of the keyframe the new stream starts with
+	NetworkDecoderFFmpegIOData video_switch_io;
+	std::deque<AVPacket *> video_switch_packets;
+
+	void prepare_video_switch();
+	void discard_video_switch(); // video_switch_lock must be held
+
   public:
 	volatile bool &hw_decoder_enabled = decoder.hw_decoder_enabled;
 	volatile bool &interrupt = decoder.interrupt;
 	volatile bool &need_reinit = decoder.need_reinit;
 	volatile const bool &ready = decoder.ready;
+	volatile int &stall_num = decoder.stall_num;
 
 	volatile bool filter_update_request = false;
 	void set_preamp(double volume) {
@@ -59,8 +114,8 @@ class NetworkMultipleDecoder {
 		filter_update_request = true;
 	}
 	void set_tempo(double tempo) {
-		decoder.filter.tempo_request = tempo;
-		filter_update_request = true;
+		user_tempo = tempo;
+		apply_tempo();
 	}
 	void set_pitch(double pitch) {
 		decoder.filter.pitch_request = pitch;
@@ -77,6 +132,9 @@ class NetworkMultipleDecoder {
 	NetworkMultipleDecoder() = default;
 
 	void deinit();
+	// the streams opened by the next init() (and the video switches after it) are cached on the SD card as those of
+	// the video `video_id`, pass "" for livestreams or not to cache them
+	void set_cache_video_id(const std::string &video_id) { cache_video_id = video_id; }
 	// pass fragment_len == -1 if it's not a livestream
 	Result_with_string init(std::string video_url, std::string audio_url, NetworkStreamDownloader &downloader,
 	                        int fragment_len, bool adjust_timestamp, bool request_hw_decoder);
@@ -86,6 +144,23 @@ class NetworkMultipleDecoder {
 	void livestream_initer_thread_func();
 	void request_thread_exit() { initer_exit_request = true; }
 
+	// whether the video stream can be switched with request_video_switch() instead of reinitializing everything
+	bool is_video_switchable() {
+		return inited && decoder.ready && video_audio_separate && !is_livestream && !decoder.is_audio_only();
+	}
+	// starts opening `video_url` in the background to switch to it at a keyframe about
+	// VIDEO_SWITCH_LEAD_SECONDS after `cur_pos`
+	void request_video_switch(std::string video_url, bool request_hw_decoder, double cur_pos);
+	// whether the prepared stream can be spliced in now that the old one has reached the switching point
+	// should be called from the decoding thread
+	bool is_video_switch_ready();
+	// true once if preparing the new stream failed (the caller should fall back to reinitializing everything)
+	bool check_video_switch_failed();
+	// should be called from the decoding thread after is_video_switch_ready() returned true,
+	// once flush_video_decoder() succeeded and the converter has taken all the frames in the output buffer
+	Result_with_string apply_video_switch();
+	Result_with_string flush_video_decoder() { return decoder.flush_video_decoder(); }
+
 	void set_frame_cores_enabled(bool *enabled) { decoder.set_frame_cores_enabled(enabled); }
 	void set_slice_cores_enabled(bool *enabled) { decoder.set_slice_cores_enabled(enabled); }
 	void request_avformat_reinit() { decoder.avformat_reinit_request[0] = decoder.avformat_reinit_request[1] = true; }
@@ -101,6 +176,16 @@ class NetworkMultipleDecoder {
 	double get_duration() {
 		return duration_first_fragment + (fragment_len != -1 ? std::min(seq_num - 1, (int)seq_head) * fragment_len : 0);
 	}
+	// should be called from the decoding thread with the current playback position to measure the latency of a
+	// livestream, and to adjust the tempo in the low-latency mode
+	void update_live_latency(double cur_pos);
+	double get_live_latency() { return live_latency; }
+	// the latency aimed at in the low-latency mode, -1 if the mode is disabled
+	double get_live_target_latency() { return low_latency_fragments ? low_latency_fragments * fragment_len : -1; }
+	bool is_live_catching_up() { return live_catching_up; }
+	// the time from issuing the download of the latest livestream fragment until it became ready, and the average
+	double get_fragment_latency_ms() { return fragment_latency_ms; }
+	double get_fragment_latency_avg_ms() { return fragment_latency_avg_ms; }
 	double get_forward_buffer() { return fragment_len == -1 ? 0 : (seq_buffered_head - seq_using - 1) * fragment_len; }
 	double get_timestamp_from_bar_pos(double pos) {
 		pos = std::min(1.0, std::max(0.0, pos));
@@ -123,6 +208,9 @@ class NetworkMultipleDecoder {
 	}
 
 	std::vector<std::pair<double, std::vector<double>>> get_buffering_progress_bars(int bar_len);
+	// the media times (in seconds) the user is likely to seek to, the most likely first
+	// some blocks at each of them are downloaded in advance while the network is otherwise idle
+	void set_prefetch_times(const std::vector<double> &times);
 
 	// the switch to the next sequence is done inside this function
 	using PacketType = NetworkDecoder::PacketType;
@@ -139,18 +227,21 @@ class NetworkMultipleDecoder {
 	}
 
 	// decode the previously read audio packet
-	Result_with_string decode_audio(int *size, u8 **data, double *cur_pos) {
+	Result_with_string decode_audio(int *size, double *cur_pos) {
 		check_filter_update();
-		auto res = decoder.decode_audio(size, data, cur_pos);
+		auto res = decoder.decode_audio(size, cur_pos);
 		return res;
 	}
+	int output_decoded_audio(u8 *data) { return decoder.output_decoded_audio(data); }
 
-	// get the previously decoded video frame raw data
-	// the pointer stored in *data should NOT be freed
-	Result_with_string get_decoded_video_frame(int width, int height, u8 **data, double *cur_pos) {
-		auto res = decoder.get_decoded_video_frame(width, height, data, cur_pos);
+	// get the previously decoded video frame
+	// HW decoder : *data receives the BGR565 image, which should NOT be freed
+	// SW decoder : *frame receives the YUV420P frame itself, which stays valid until release_decoded_video_frame()
+	Result_with_string get_decoded_video_frame(u8 **data, AVFrame **frame, double *cur_pos) {
+		auto res = decoder.get_decoded_video_frame(data, frame, cur_pos);
 		return res;
 	}
+	void release_decoded_video_frame() { decoder.release_decoded_video_frame(); }
 
 	// seek both audio and video
 	Result_with_string seek(s64 microseconds);
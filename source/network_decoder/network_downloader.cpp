@@ -1,14 +1,219 @@
 #include "headers.hpp"
 #include "network_downloader.hpp"
 #include "network_io.hpp"
+#include "stream_cache.hpp"
+#include "system/file.hpp"
 
 #define MAX_CACHE_BLOCKS                                                                                               \
 	(var_is_new3ds ? NetworkStream::NEW3DS_MAX_CACHE_BLOCKS : NetworkStream::OLD3DS_MAX_CACHE_BLOCKS)
 
+// --------------------------------
+// block pool
+// --------------------------------
+
+// every block of every stream is stored in one of the BLOCK_SIZE buffers of a single slab
+// the slab is allocated when the first stream is constructed and is never resized, so that the blocks coming and
+// going during playback (and the videos played one after another) do not touch the general heap
+// it holds the whole cache of a video and an audio stream plus some room for the stream prebuffered for a quality
+// switch and livestream fragments, and is released when the player exits (NetworkStreamDownloader::delete_all())
+#define BLOCK_POOL_SIZE (MAX_CACHE_BLOCKS * 2 + 8)
+static Mutex block_pool_lock;
+static u8 *block_pool_slab = NULL;
+static std::vector<u8 *> block_pool_free_buffers;
+static std::vector<NetworkStream *> block_pool_streams; // the streams sharing the pool
+static bool block_pool_release_requested = false;
+
+static void block_pool_release() {
+	free(block_pool_slab);
+	block_pool_slab = NULL;
+	block_pool_free_buffers.clear();
+	block_pool_release_requested = false;
+}
+static void block_pool_attach(NetworkStream *stream) {
+	block_pool_lock.lock();
+	block_pool_release_requested = false;
+	if (!block_pool_slab) {
+		block_pool_slab = (u8 *)malloc(BLOCK_POOL_SIZE * NetworkStream::BLOCK_SIZE);
+		if (block_pool_slab) {
+			block_pool_free_buffers.reserve(BLOCK_POOL_SIZE);
+			for (int i = BLOCK_POOL_SIZE - 1; i >= 0; i--) {
+				block_pool_free_buffers.push_back(block_pool_slab + i * NetworkStream::BLOCK_SIZE);
+			}
+		} else {
+			logger.error("net/dl", "block pool : out of memory for " + std::to_string(BLOCK_POOL_SIZE) + " blocks");
+		}
+	}
+	block_pool_streams.push_back(stream);
+	block_pool_lock.unlock();
+}
+// the streams give their blocks back before detaching
+static void block_pool_detach(NetworkStream *stream) {
+	block_pool_lock.lock();
+	block_pool_streams.erase(std::find(block_pool_streams.begin(), block_pool_streams.end(), stream));
+	if (block_pool_release_requested && !block_pool_streams.size()) {
+		block_pool_release();
+	}
+	block_pool_lock.unlock();
+}
+// releases the slab once the last stream is destroyed
+static void block_pool_request_release() {
+	block_pool_lock.lock();
+	if (block_pool_streams.size()) {
+		block_pool_release_requested = true;
+	} else {
+		block_pool_release();
+	}
+	block_pool_lock.unlock();
+}
+static std::vector<NetworkStream *> block_pool_get_streams() {
+	block_pool_lock.lock();
+	std::vector<NetworkStream *> res = block_pool_streams;
+	block_pool_lock.unlock();
+	return res;
+}
+// returns NULL if every buffer is in use
+static u8 *block_pool_alloc() {
+	u8 *res = NULL;
+	block_pool_lock.lock();
+	if (block_pool_free_buffers.size()) {
+		res = block_pool_free_buffers.back();
+		block_pool_free_buffers.pop_back();
+	}
+	block_pool_lock.unlock();
+	return res;
+}
+static void block_pool_free(u8 *buffer) {
+	block_pool_lock.lock();
+	block_pool_free_buffers.push_back(buffer);
+	block_pool_lock.unlock();
+}
+
 // --------------------------------
 // NetworkStream implementation
 // --------------------------------
 
+u64 NetworkStream::get_forward_window_block_num() {
+	// the first and the last blocks are always kept
+	return std::max<int>(2, (MAX_CACHE_BLOCKS - 2) * var_forward_buffer_ratio);
+}
+u64 NetworkStream::get_prefetch_block_num() {
+	u64 used = 2 + get_forward_window_block_num() + BACK_WINDOW_BLOCKS;
+	return MAX_CACHE_BLOCKS > used ? MAX_CACHE_BLOCKS - used : 0;
+}
+
+void NetworkStream::set_read_head(u64 new_read_head) {
+	bool block_changed = new_read_head / BLOCK_SIZE != read_head / BLOCK_SIZE;
+	read_head = new_read_head;
+	if (block_changed && downloader) {
+		downloader->wake_up(); // the forward window has moved
+	}
+}
+
+void NetworkStream::set_time_index(double duration, std::vector<std::pair<u64, double>> entries) {
+	std::sort(entries.begin(), entries.end());
+	std::vector<std::pair<u64, double>> anchors = {{0, 0}};
+	for (auto &entry : entries) {
+		// skip the entries that would make the mapping non-monotonic
+		if (entry.first > anchors.back().first && entry.second >= anchors.back().second) {
+			anchors.push_back(entry);
+		}
+	}
+	if (duration > 0 && len > anchors.back().first && duration >= anchors.back().second) {
+		anchors.push_back({len, duration});
+	}
+	if (anchors.size() < 2) {
+		anchors.clear();
+	}
+
+	time_index_lock.lock();
+	time_index = std::move(anchors);
+	time_index_lock.unlock();
+}
+double NetworkStream::get_time(u64 pos) {
+	double res = -1;
+	time_index_lock.lock();
+	if (time_index.size()) {
+		auto itr = std::upper_bound(time_index.begin(), time_index.end(), std::make_pair(pos, 1e300));
+		if (itr == time_index.end()) {
+			res = time_index.back().second;
+		} else {
+			auto prev = std::prev(itr); // time_index[0] is {0, 0}, so there is always one
+			res = prev->second +
+			      (itr->second - prev->second) * (double)(pos - prev->first) / (itr->first - prev->first);
+		}
+	}
+	time_index_lock.unlock();
+	return res;
+}
+int64_t NetworkStream::get_pos(double time) {
+	int64_t res = -1;
+	time_index_lock.lock();
+	if (time_index.size()) {
+		auto itr = std::upper_bound(time_index.begin(), time_index.end(), time,
+		                            [](double time, const std::pair<u64, double> &anchor) { return time < anchor.second; });
+		if (itr == time_index.end()) {
+			res = time_index.back().first;
+		} else {
+			auto prev = std::prev(itr); // time_index[0] is {0, 0}, so there is always one (unless `time` < 0)
+			if (time < 0) {
+				res = 0;
+			} else {
+				res = prev->first + (itr->first - prev->first) * (time - prev->second) / (itr->second - prev->second);
+			}
+		}
+	}
+	time_index_lock.unlock();
+	return res;
+}
+void NetworkStream::set_prefetch_times(const std::vector<double> &times) {
+	time_index_lock.lock();
+	bool changed = prefetch_times != times;
+	prefetch_times = times;
+	time_index_lock.unlock();
+	if (changed && downloader) {
+		downloader->wake_up();
+	}
+}
+void NetworkStream::update_prefetch_blocks() {
+	prefetch_blocks.clear();
+	time_index_lock.lock();
+	std::vector<double> times = prefetch_times;
+	time_index_lock.unlock();
+
+	u64 read_head_block = read_head / BLOCK_SIZE;
+	u64 forward_end_block = read_head_block + get_forward_window_block_num();
+	u64 block_num_max = get_prefetch_block_num();
+	for (auto time : times) {
+		int64_t start = get_pos(std::max(0.0, time - PREFETCH_SECONDS_BEFORE));
+		int64_t end = get_pos(time);
+		if (start < 0 || end < 0) {
+			break; // the time index is not known yet
+		}
+		for (u64 block = start / BLOCK_SIZE; block <= (u64)end / BLOCK_SIZE && block < block_num; block++) {
+			if (prefetch_blocks.size() >= block_num_max) {
+				return;
+			}
+			// those in the forward window are downloaded anyway
+			if ((block < read_head_block || block >= forward_end_block) &&
+			    std::find(prefetch_blocks.begin(), prefetch_blocks.end(), block) == prefetch_blocks.end()) {
+				prefetch_blocks.push_back(block);
+			}
+		}
+	}
+}
+
+NetworkStream::NetworkStream(std::string url, int64_t len, bool whole_download, NetworkSessionList *session_list)
+    : url(url), len(len < 0 ? 0 : len), block_num(get_block_num(this->len)), whole_download(whole_download),
+      session_list(session_list) {
+	block_pool_attach(this);
+}
+NetworkStream::~NetworkStream() {
+	for (auto block : cached_blocks) {
+		block_pool_free(block_data[block]);
+	}
+	block_pool_detach(this);
+}
+
 bool NetworkStream::is_data_available(u64 start, u64 size) {
 	if (!ready) {
 		return false;
@@ -23,7 +228,7 @@ bool NetworkStream::is_data_available(u64 start, u64 size) {
 	bool res = true;
 	downloaded_data_lock.lock();
 	for (u64 block = start_block; block <= end_block; block++) {
-		if (!downloaded_data.count(block)) {
+		if (!is_block_available(block)) {
 			res = false;
 			break;
 		}
@@ -31,75 +236,146 @@ bool NetworkStream::is_data_available(u64 start, u64 size) {
 	downloaded_data_lock.unlock();
 	return res;
 }
-std::vector<u8> NetworkStream::get_data(u64 start, u64 size) {
+size_t NetworkStream::read_data(u64 start, u64 size, u8 *buf) {
 	if (!ready) {
-		return {};
-	}
-	if (!size) {
-		return {};
+		return 0;
 	}
-	u64 end = start + size - 1;
-	u64 start_block = start / BLOCK_SIZE;
-	u64 end_block = end / BLOCK_SIZE;
-	std::vector<u8> res;
+	u64 end = std::min(start + size, len);
+	size_t res = 0;
 
 	downloaded_data_lock.lock();
-	auto itr = downloaded_data.find(start_block);
-	my_assert(itr != downloaded_data.end());
-	for (u64 block = start_block; block <= end_block; block++) {
-		my_assert(itr->first == block);
-		u64 cur_l = std::max(start, block * BLOCK_SIZE) - block * BLOCK_SIZE;
-		u64 cur_r = std::min(end + 1, (block + 1) * BLOCK_SIZE) - block * BLOCK_SIZE;
-		res.insert(res.end(), itr->second.begin() + cur_l, itr->second.begin() + cur_r);
-		itr++;
+	for (u64 block = start / BLOCK_SIZE; start + res < end && is_block_available(block); block++) {
+		u64 cur_l = start + res - block * BLOCK_SIZE;
+		u64 cur_r = std::min(end, (block + 1) * BLOCK_SIZE) - block * BLOCK_SIZE;
+		memcpy(buf + res, block_data[block] + cur_l, cur_r - cur_l);
+		res += cur_r - cur_l;
 	}
 	downloaded_data_lock.unlock();
 	return res;
 }
 
-void NetworkStream::set_data(u64 block, std::vector<u8> data) {
-	downloaded_data_lock.lock();
+// 0 : outside every window, 1 : back window or prefetch target, 2 : forward window, 3 : pinned
+// among the same rank, the one with the larger `distance` from the read head is evicted first
+int NetworkStream::get_retention_rank(u64 block, u64 *distance) {
+	u64 read_head_block = read_head / BLOCK_SIZE;
+	*distance = block >= read_head_block ? block - read_head_block : read_head_block - block;
+	// the container index (moov, Cues etc.) is located at either end of the file, and is read again on every seek
+	if (block == 0 || block + 1 == block_num) {
+		return 3;
+	}
+	if (block >= read_head_block && block < read_head_block + get_forward_window_block_num()) {
+		return 2;
+	}
+	if (block < read_head_block && block + BACK_WINDOW_BLOCKS >= read_head_block) {
+		return 1;
+	}
+	if (std::find(prefetch_blocks.begin(), prefetch_blocks.end(), block) != prefetch_blocks.end()) {
+		return 1;
+	}
+	return 0;
+}
+void NetworkStream::release_block(u64 block) {
+	block_pool_free(block_data[block]);
+	block_data[block] = NULL;
+	block_available[block / 32] &= ~((u32)1 << (block % 32));
+	cached_blocks.erase(std::find(cached_blocks.begin(), cached_blocks.end(), block));
+}
+bool NetworkStream::evict_block_for(u64 block, bool own_only) {
+	u64 new_distance;
+	int new_rank = get_retention_rank(block, &new_distance);
+	// the streams are only destroyed on the downloader thread (or after it exits), so the list stays valid
+	std::vector<NetworkStream *> candidates = own_only ? std::vector<NetworkStream *>{this} : block_pool_get_streams();
 
-	// if you move it, it doesn't perform a copy which means you will never get a std::bad_alloc which used to happen before
-	downloaded_data[block] = std::move(data);
+	NetworkStream *victim_stream = NULL;
+	u64 victim = 0;
+	u64 victim_distance = 0;
+	int victim_rank = 0;
+	for (auto stream : candidates) {
+		if (stream != this && stream->whole_download) {
+			continue; // livestream fragments are not downloaded again
+		}
+		// only the downloader thread modifies the cache, so it can be scanned without locking
+		for (auto cur_block : stream->cached_blocks) {
+			u64 cur_distance;
+			int cur_rank = stream->get_retention_rank(cur_block, &cur_distance);
+			if (cur_rank == 3) {
+				continue;
+			}
+			if (!victim_stream || cur_rank < victim_rank ||
+			    (cur_rank == victim_rank && cur_distance > victim_distance)) {
+				victim_stream = stream;
+				victim = cur_block;
+				victim_rank = cur_rank;
+				victim_distance = cur_distance;
+			}
+		}
+	}
+	if (!victim_stream || victim_rank > new_rank || (victim_rank == new_rank && victim_distance < new_distance)) {
+		return false; // the new block is the least worth keeping
+	}
+	if (victim_stream != this) {
+		victim_stream->downloaded_data_lock.lock();
+	}
+	victim_stream->release_block(victim);
+	if (victim_stream != this) {
+		victim_stream->downloaded_data_lock.unlock();
+	}
+	return true;
+}
+bool NetworkStream::set_data(u64 block, const u8 *data, size_t size) {
+	my_assert(size <= BLOCK_SIZE);
+	downloaded_data_lock.lock();
 
-	if (downloaded_data.size() > MAX_CACHE_BLOCKS) { // ensure it doesn't cache too much and run out of memory
-		u64 read_head_block = read_head / BLOCK_SIZE;
-		if (std::next(downloaded_data.begin())->first < read_head_block) {
-			downloaded_data.erase(std::next(downloaded_data.begin()));
-		} else {
-			downloaded_data.erase(std::prev(downloaded_data.end()));
+	if (block_data.size() < std::max(block_num, block + 1)) {
+		block_data.resize(std::max(block_num, block + 1), NULL);
+		block_available.resize((block_data.size() + 31) / 32, 0);
+	}
+	if (!block_data[block]) {
+		// ensure it doesn't cache too much : give up the block least worth keeping, in this stream once it holds its
+		// share of the cache, in any stream once the pool is used up
+		u8 *buffer = NULL;
+		while (true) {
+			bool share_used = cached_blocks.size() >= MAX_CACHE_BLOCKS;
+			if (!share_used && (buffer = block_pool_alloc())) {
+				break;
+			}
+			if (!evict_block_for(block, share_used)) {
+				break;
+			}
+		}
+		if (!buffer) {
+			downloaded_data_lock.unlock();
+			return false;
 		}
+		block_data[block] = buffer;
+		block_available[block / 32] |= (u32)1 << (block % 32);
+		cached_blocks.push_back(block);
 	}
+	memcpy(block_data[block], data, size);
+
 	downloaded_data_lock.unlock();
+	return true;
 }
 double NetworkStream::get_download_percentage() {
 	downloaded_data_lock.lock();
-	double res = (double)downloaded_data.size() * BLOCK_SIZE / len * 100;
+	double res = (double)cached_blocks.size() * BLOCK_SIZE / len * 100;
 	downloaded_data_lock.unlock();
 	return res;
 }
 std::vector<double> NetworkStream::get_buffering_progress_bar(int res_len) {
 	downloaded_data_lock.lock();
 	std::vector<double> res(res_len);
-	auto itr = downloaded_data.begin();
 	for (int i = 0; i < res_len; i++) {
 		u64 l = (u64)len * i / res_len;
 		u64 r = std::min<u64>(len, len * (i + 1) / res_len);
-		while (itr != downloaded_data.end()) {
-			u64 il = itr->first * BLOCK_SIZE;
-			u64 ir = std::min((itr->first + 1) * BLOCK_SIZE, len);
-			if (ir <= l) {
-				itr++;
-			} else if (il >= r) {
-				break;
-			} else {
+		if (l >= r) {
+			continue;
+		}
+		for (u64 block = l / BLOCK_SIZE; block <= (r - 1) / BLOCK_SIZE; block++) {
+			if (is_block_available(block)) {
+				u64 il = block * BLOCK_SIZE;
+				u64 ir = std::min((block + 1) * BLOCK_SIZE, len);
 				res[i] += std::min(ir, r) - std::max(il, l);
-				if (ir >= r) {
-					break;
-				} else {
-					itr++;
-				}
 			}
 		}
 		res[i] /= r - l;
@@ -127,7 +403,9 @@ void NetworkStreamDownloader::add_stream(NetworkStream *stream) {
 		index = streams.size();
 		streams.push_back(stream);
 	}
+	stream->downloader = this;
 	streams_lock.unlock();
+	wake_up();
 }
 
 static bool thread_network_session_list_inited = false;
@@ -156,10 +434,284 @@ static std::string remove_url_parameter(const std::string &url, const std::strin
 }
 
 #define LOG_THREAD_STR "net/dl"
+#define THROUGHPUT_WINDOW_MS 2000
+#define THROUGHPUT_EWMA_WEIGHT 0.3 // the weight of the newest window
+// upper bounds of the waits, for the changes that come without wake_up() (e.g. suspend_request)
+#define IDLE_WAIT_MS 100
+#define NETWORK_WAIT_MS 100
+
+void NetworkStreamDownloader::wake_up() {
+	wakeup_event.signal();                // when idle
+	thread_network_session_list.wakeup(); // when waiting for the range requests
+}
+
+static NetworkSessionList &get_session_list(NetworkStream *stream) {
+	confirm_thread_network_session_list_inited();
+	return stream->session_list ? *stream->session_list : thread_network_session_list;
+}
+
+int NetworkStreamDownloader::get_max_requests_per_stream() {
+	if (max_requests_per_stream > 0) {
+		return max_requests_per_stream;
+	}
+	return var_is_new3ds ? NEW3DS_MAX_REQUESTS_PER_STREAM : OLD3DS_MAX_REQUESTS_PER_STREAM;
+}
+bool NetworkStreamDownloader::is_block_in_flight(NetworkStream *stream, u64 block) {
+	for (auto &request : in_flight) {
+		if (request.second.stream == stream && request.second.block == block) {
+			return true;
+		}
+	}
+	return false;
+}
+int NetworkStreamDownloader::get_in_flight_num(NetworkStream *stream) {
+	int res = 0;
+	for (auto &request : in_flight) {
+		res += request.second.stream == stream;
+	}
+	return res;
+}
+void NetworkStreamDownloader::submit_range_request(NetworkStream *stream, u64 block, bool prefetch) {
+	u64 start = block * BLOCK_SIZE;
+	u64 end = stream->ready ? std::min((block + 1) * BLOCK_SIZE, stream->len) : (block + 1) * BLOCK_SIZE;
+	u64 expected_len = stream->ready ? end - start : 0;
+
+	auto &session_list = get_session_list(stream);
+	// length not sure -> use Range header to get the size (slower)
+	int id = stream->len == 0
+	             ? session_list.submit(HttpRequest::GET(
+	                   stream->url, {{"Range", "bytes=" + std::to_string(start) + "-" + std::to_string(end - 1)}}))
+	             : session_list.submit(HttpRequest::GET(
+	                   stream->url + "&range=" + std::to_string(start) + "-" + std::to_string(end - 1), {}));
+	in_flight[{&session_list, id}] = {stream, block, expected_len, prefetch, false};
+}
+void NetworkStreamDownloader::submit_whole_request(NetworkStream *stream) {
+	auto &session_list = get_session_list(stream);
+	int id = session_list.submit(HttpRequest::GET(stream->url, {}));
+	in_flight[{&session_list, id}] = {stream, 0, 0, false, true};
+}
+void NetworkStreamDownloader::cancel_requests(NetworkStream *stream, u64 window_start, u64 window_end) {
+	for (auto itr = in_flight.begin(); itr != in_flight.end();) {
+		bool still_prefetched = itr->second.prefetch && window_end &&
+		                        std::find(stream->prefetch_blocks.begin(), stream->prefetch_blocks.end(),
+		                                  itr->second.block) != stream->prefetch_blocks.end();
+		if (itr->second.stream == stream && (itr->second.block < window_start || itr->second.block >= window_end) &&
+		    !still_prefetched) {
+			itr->first.first->cancel(itr->first.second);
+			itr = in_flight.erase(itr);
+		} else {
+			itr++;
+		}
+	}
+}
+bool NetworkStreamDownloader::load_block_from_sd(NetworkStream *stream, u64 block) {
+	if (stream->is_local()) {
+		Path path(stream->url.substr(strlen(LOCAL_STREAM_URL_PREFIX)));
+		if (!stream->ready) {
+			u64 file_size = 0;
+			Result_with_string result = path.get_size(file_size);
+			if (result.code != 0 || !file_size) {
+				logger.error(LOG_THREAD_STR, "failed to open the local stream " + path.path + " : " + result.string);
+				stream->error = true;
+				stream->data_event.signal();
+				return true;
+			}
+			stream->len = file_size;
+			stream->block_num = NetworkStream::get_block_num(file_size);
+			stream->ready = true;
+		}
+		u64 size = std::min(BLOCK_SIZE, stream->len - block * BLOCK_SIZE);
+		u32 size_read = 0;
+		sd_read_buffer.resize(BLOCK_SIZE);
+		Result_with_string result = path.read_file(sd_read_buffer.data(), size, size_read, block * BLOCK_SIZE);
+		if (result.code != 0 || size_read != size) {
+			logger.error(LOG_THREAD_STR, "failed to read the local stream " + path.path + " : " + result.string);
+			stream->error = true;
+		} else if (!stream->set_data(block, sd_read_buffer.data(), size)) {
+			logger.error(LOG_THREAD_STR, "no room for the block " + std::to_string(block) + " of " + path.path);
+			stream->error = true;
+		}
+		stream->data_event.signal();
+		return true;
+	}
+
+	if (!stream->ready || stream->whole_download || stream->cache_key == "") {
+		return false;
+	}
+	u64 size = std::min(BLOCK_SIZE, stream->len - block * BLOCK_SIZE);
+	sd_read_buffer.resize(BLOCK_SIZE);
+	if (!stream_cache_read(stream->cache_key, block, sd_read_buffer.data(), size)) {
+		return false;
+	}
+	if (!stream->set_data(block, sd_read_buffer.data(), size)) {
+		return false; // download it instead, which fails the same way and uses up the retries
+	}
+	stream->data_event.signal();
+	return true;
+}
+void NetworkStreamDownloader::on_range_request_finished(const InFlightRequest &request, NetworkResult &result) {
+	NetworkStream *cur_stream = request.stream;
+	if (result.redirected_url != "") {
+		cur_stream->url = remove_url_parameter(result.redirected_url, "range");
+	}
+
+	if (!result.fail && result.status_code_is_success()) {
+		if (cur_stream->len == 0) {
+			auto content_range_str = result.get_header("Content-Range");
+			char *slash = strchr(content_range_str.c_str(), '/');
+			bool ok = false;
+			if (slash) {
+				char *end;
+				cur_stream->len = strtoll(slash + 1, &end, 10);
+				if (!*end) {
+					ok = true;
+					cur_stream->block_num = NetworkStream::get_block_num(cur_stream->len);
+				} else {
+					logger.error(LOG_THREAD_STR, "failed to parse Content-Range : " + std::string(slash + 1));
+				}
+			} else {
+				logger.error(LOG_THREAD_STR, "no slash in Content-Range response header : " + content_range_str);
+			}
+			if (!ok) {
+				cur_stream->error = true;
+			}
+		}
+		if (request.expected_len && result.data.size() != request.expected_len) {
+			logger.error(LOG_THREAD_STR, "size discrepancy : " + std::to_string(request.expected_len) + " -> " +
+			                                 std::to_string(result.data.size()));
+			if (cur_stream->retry_cnt_left) {
+				cur_stream->retry_cnt_left--;
+			} else {
+				cur_stream->error = true;
+			}
+			return;
+		}
+		if (!cur_stream->set_data(request.block, result.data.data(), result.data.size())) {
+			logger.error(LOG_THREAD_STR, "no room for the block " + std::to_string(request.block));
+			if (cur_stream->retry_cnt_left) {
+				cur_stream->retry_cnt_left--;
+			} else {
+				cur_stream->error = true;
+			}
+			return;
+		}
+		cur_stream->retry_cnt_left = NetworkStream::RETRY_CNT_MAX;
+		if (!cur_stream->ready && cur_stream->cache_video_id != "") {
+			cur_stream->cache_key = stream_cache_make_key(cur_stream->cache_video_id, cur_stream->url, cur_stream->len);
+		}
+		cur_stream->ready = true;
+		// only whole blocks, as the first request of a stream with unknown length may be cut anywhere
+		if (cur_stream->cache_key != "" &&
+		    result.data.size() == std::min(BLOCK_SIZE, cur_stream->len - request.block * BLOCK_SIZE)) {
+			stream_cache_write(cur_stream->cache_key, request.block, std::move(result.data));
+		}
+	} else if (!result.fail) {
+		logger.error("net/dl", "stream returned: " + std::to_string(result.status_code));
+		cur_stream->error = true;
+	} else {
+		logger.error("net/dl", "access failed : " + result.error);
+		if (cur_stream->retry_cnt_left) {
+			cur_stream->retry_cnt_left--;
+		} else {
+			cur_stream->error = true;
+		}
+	}
+}
+void NetworkStreamDownloader::on_whole_request_finished(const InFlightRequest &request, NetworkResult &result) {
+	NetworkStream *cur_stream = request.stream;
+	if (result.redirected_url != "") {
+		cur_stream->url = result.redirected_url;
+	}
+
+	if (!result.fail && result.status_code_is_success() && result.data.size()) {
+		{ // acquire necessary headers
+			char *end;
+			auto value = result.get_header("x-head-seqnum");
+			cur_stream->seq_head = strtoll(value.c_str(), &end, 10);
+			if (*end || !value.size()) {
+				logger.error("net/dl", "failed to acquire x-head-seqnum");
+				cur_stream->seq_head = -1;
+				cur_stream->error = true;
+			}
+			value = result.get_header("x-sequence-num");
+			cur_stream->seq_id = strtoll(value.c_str(), &end, 10);
+			if (*end || !value.size()) {
+				logger.error("net/dl", "failed to acquire x-sequence-num");
+				cur_stream->seq_id = -1;
+				cur_stream->error = true;
+			}
+		}
+		if (!cur_stream->error) {
+			cur_stream->len = result.data.size();
+			cur_stream->block_num = (cur_stream->len + BLOCK_SIZE - 1) / BLOCK_SIZE;
+			for (size_t i = 0; i < result.data.size(); i += BLOCK_SIZE) {
+				size_t size = std::min<size_t>(BLOCK_SIZE, result.data.size() - i);
+				if (!cur_stream->set_data(i / BLOCK_SIZE, result.data.data() + i, size)) {
+					logger.error(LOG_THREAD_STR, "no room for the fragment " + std::to_string(cur_stream->seq_id));
+					cur_stream->error = true;
+					break;
+				}
+			}
+			cur_stream->ready = !cur_stream->error;
+		}
+	} else {
+		logger.error("net/dl", "failed accessing : " + result.error);
+		cur_stream->error = true;
+		switch (result.status_code) {
+		// these codes are returned when trying to read beyond the end of the livestream
+		case HTTP_STATUS_CODE_NO_CONTENT:
+		case HTTP_STATUS_CODE_NOT_FOUND:
+			cur_stream->livestream_eof = true;
+			break;
+		// this code is returned when trying to read an ended livestream without archive
+		case HTTP_STATUS_CODE_FORBIDDEN:
+			cur_stream->livestream_private = true;
+			break;
+		}
+	}
+}
+void NetworkStreamDownloader::add_throughput_sample(u64 bytes, double elapsed_ms) {
+	throughput_lock.lock();
+	downloaded_bytes += bytes;
+	downloading_time_ms += elapsed_ms;
+	recent_window_bytes += bytes;
+	recent_window_time_ms += elapsed_ms;
+	if (recent_window_time_ms >= THROUGHPUT_WINDOW_MS) {
+		recent_throughput = recent_window_bytes * 1000.0 / recent_window_time_ms;
+		if (throughput_estimate == 0) {
+			throughput_estimate = recent_throughput;
+		} else {
+			throughput_estimate =
+			    THROUGHPUT_EWMA_WEIGHT * recent_throughput + (1 - THROUGHPUT_EWMA_WEIGHT) * throughput_estimate;
+		}
+		recent_window_bytes = 0;
+		recent_window_time_ms = 0;
+	}
+	throughput_lock.unlock();
+}
+double NetworkStreamDownloader::get_throughput() {
+	throughput_lock.lock();
+	double res = downloading_time_ms > 0 ? downloaded_bytes * 1000.0 / downloading_time_ms : 0;
+	throughput_lock.unlock();
+	return res;
+}
+double NetworkStreamDownloader::get_recent_throughput() {
+	throughput_lock.lock();
+	double res = recent_throughput;
+	throughput_lock.unlock();
+	return res;
+}
+double NetworkStreamDownloader::get_estimated_throughput() {
+	throughput_lock.lock();
+	double res = throughput_estimate;
+	throughput_lock.unlock();
+	return res;
+}
+
 void NetworkStreamDownloader::downloader_thread() {
+	TickCounter throughput_timer;
+	osTickCounterStart(&throughput_timer);
 	while (!thread_exit_requested) {
-		size_t cur_stream_index =
-		    (size_t)-1; // the index of the stream on which we will perform a download in this loop
 		streams_lock.lock();
 		// back up 'read_head's as those can be changed from another thread
 		std::vector<u64> read_heads(streams.size());
@@ -169,205 +721,186 @@ void NetworkStreamDownloader::downloader_thread() {
 			}
 		}
 
-		// find the stream to download next
-		double margin_percentage_min = 1000;
+		int forward_buffer_block_num = NetworkStream::get_forward_window_block_num();
 		for (size_t i = 0; i < streams.size(); i++) {
 			if (!streams[i]) {
 				continue;
 			}
 			if (streams[i]->quit_request) {
+				cancel_requests(streams[i], 0, 0);
 				delete streams[i];
 				streams[i] = NULL;
 				continue;
 			}
-			if (streams[i]->error) {
-				continue;
-			}
-			if (streams[i]->suspend_request) {
-				continue;
-			}
-			if (!streams[i]->ready) {
-				cur_stream_index = i;
-				break;
-			}
-			if (streams[i]->whole_download) {
-				continue; // its entire content should already be downloaded
-			}
-
-			int forward_buffer_block_num =
-			    std::max<int>(2, (MAX_CACHE_BLOCKS - 1) * var_forward_buffer_ratio); // block #0 is always kept
-			u64 read_head_block = read_heads[i] / BLOCK_SIZE;
-			u64 first_not_downloaded_block = read_head_block;
-			while (first_not_downloaded_block < streams[i]->block_num &&
-			       streams[i]->downloaded_data.count(first_not_downloaded_block)) {
-				first_not_downloaded_block++;
-				if (first_not_downloaded_block == read_head_block + forward_buffer_block_num) {
-					break;
-				}
-			}
-			if (first_not_downloaded_block == streams[i]->block_num) {
-				continue;
-			}
-			if (first_not_downloaded_block == read_head_block + forward_buffer_block_num) {
-				continue; // no need to download this stream for now
-			}
-
-			double margin_percentage;
-			if (first_not_downloaded_block == read_head_block) {
-				margin_percentage = 0;
-			} else {
-				margin_percentage =
-				    (double)(first_not_downloaded_block * BLOCK_SIZE - read_heads[i]) / streams[i]->len * 100;
-			}
-			if (margin_percentage_min > margin_percentage) {
-				margin_percentage_min = margin_percentage;
-				cur_stream_index = i;
+			// blocks the reader no longer needs (e.g. after a seek) are not worth waiting for
+			if (streams[i]->ready && !streams[i]->whole_download) {
+				streams[i]->update_prefetch_blocks();
+				u64 read_head_block = read_heads[i] / BLOCK_SIZE;
+				cancel_requests(streams[i], read_head_block, read_head_block + forward_buffer_block_num);
 			}
 		}
 
-		if (cur_stream_index == (size_t)-1) {
-			streams_lock.unlock();
-			usleep(20000);
-			continue;
-		}
-		NetworkStream *cur_stream = streams[cur_stream_index];
-		streams_lock.unlock();
-
-		confirm_thread_network_session_list_inited();
-		// whole download
-		if (cur_stream->whole_download) {
-			auto &session_list = cur_stream->session_list ? *cur_stream->session_list : thread_network_session_list;
-			auto result = session_list.perform(HttpRequest::GET(cur_stream->url, {}));
-			if (result.redirected_url != "") {
-				cur_stream->url = result.redirected_url;
+		// livestream fragments come first : the livestream initer decides how many of them are fetched ahead
+		for (size_t i = 0; i < streams.size(); i++) {
+			if (streams[i] && streams[i]->whole_download && !streams[i]->ready && !streams[i]->error &&
+			    !streams[i]->suspend_request && !get_in_flight_num(streams[i])) {
+				submit_whole_request(streams[i]);
 			}
+		}
 
-			if (!result.fail && result.status_code_is_success() && result.data.size()) {
-				{ // acquire necessary headers
-					char *end;
-					auto value = result.get_header("x-head-seqnum");
-					cur_stream->seq_head = strtoll(value.c_str(), &end, 10);
-					if (*end || !value.size()) {
-						logger.error("net/dl", "failed to acquire x-head-seqnum");
-						cur_stream->seq_head = -1;
-						cur_stream->error = true;
-					}
-					value = result.get_header("x-sequence-num");
-					cur_stream->seq_id = strtoll(value.c_str(), &end, 10);
-					if (*end || !value.size()) {
-						logger.error("net/dl", "failed to acquire x-sequence-num");
-						cur_stream->seq_id = -1;
-						cur_stream->error = true;
-					}
+		// fill the free request slots, each time with the block of the stream with the least seconds buffered
+		int max_requests_per_stream = get_max_requests_per_stream();
+		while (true) {
+			size_t cur_stream_index = (size_t)-1; // the index of the stream on which we will perform a download next
+			u64 cur_block = 0;
+			double margin_seconds_min = std::numeric_limits<double>::infinity();
+			for (size_t i = 0; i < streams.size(); i++) {
+				if (!streams[i] || streams[i]->error || streams[i]->suspend_request) {
+					continue;
+				}
+				if (streams[i]->whole_download) {
+					continue; // downloaded at once above
 				}
-				if (!cur_stream->error) {
-					cur_stream->len = result.data.size();
-					cur_stream->block_num = (cur_stream->len + BLOCK_SIZE - 1) / BLOCK_SIZE;
-					for (size_t i = 0; i < result.data.size(); i += BLOCK_SIZE) {
-						size_t left = i;
-						size_t right = std::min<size_t>(i + BLOCK_SIZE, result.data.size());
-						cur_stream->set_data(i / BLOCK_SIZE,
-						                     std::vector<u8>(result.data.begin() + left, result.data.begin() + right));
+				if (!streams[i]->ready) {
+					// the length is not known until the first request finishes
+					if (!get_in_flight_num(streams[i])) {
+						cur_stream_index = i;
+						cur_block = read_heads[i] / BLOCK_SIZE;
+						break;
 					}
-					cur_stream->ready = true;
+					continue;
 				}
-			} else {
-				logger.error("net/dl", "failed accessing : " + result.error);
-				cur_stream->error = true;
-				switch (result.status_code) {
-				// these codes are returned when trying to read beyond the end of the livestream
-				case HTTP_STATUS_CODE_NO_CONTENT:
-				case HTTP_STATUS_CODE_NOT_FOUND:
-					cur_stream->livestream_eof = true;
-					break;
-				// this code is returned when trying to read an ended livestream without archive
-				case HTTP_STATUS_CODE_FORBIDDEN:
-					cur_stream->livestream_private = true;
-					break;
+				if (get_in_flight_num(streams[i]) >= max_requests_per_stream) {
+					continue;
 				}
-			}
-		} else {
-			u64 block_reading = read_heads[cur_stream_index] / BLOCK_SIZE;
-			if (cur_stream->ready) {
-				while (block_reading < cur_stream->block_num && cur_stream->downloaded_data.count(block_reading)) {
-					block_reading++;
+
+				// blocks being downloaded count as the margin as well
+				u64 read_head_block = read_heads[i] / BLOCK_SIZE;
+				u64 first_not_downloaded_block = read_head_block;
+				while (first_not_downloaded_block < streams[i]->block_num &&
+				       (streams[i]->is_block_available(first_not_downloaded_block) ||
+				        is_block_in_flight(streams[i], first_not_downloaded_block))) {
+					first_not_downloaded_block++;
+					if (first_not_downloaded_block == read_head_block + forward_buffer_block_num) {
+						break;
+					}
 				}
-				if (block_reading == cur_stream->block_num) { // something unexpected happened
-					logger.error(LOG_THREAD_STR, "unexpected error (trying to read beyond the end of the stream)");
-					cur_stream->error = true;
+				if (first_not_downloaded_block == streams[i]->block_num) {
 					continue;
 				}
-			}
-			// Util_log_save("net/dl", "dl next : " + std::to_string(cur_stream_index) + " " +
-			// std::to_string(block_reading));
-
-			u64 start = block_reading * BLOCK_SIZE;
-			u64 end = cur_stream->ready ? std::min((block_reading + 1) * BLOCK_SIZE, cur_stream->len)
-			                            : (block_reading + 1) * BLOCK_SIZE;
-			u64 expected_len = end - start;
-
-			auto &session_list = cur_stream->session_list ? *cur_stream->session_list : thread_network_session_list;
-			// length not sure -> use Range header to get the size (slower)
-			auto result =
-			    cur_stream->len == 0
-			        ? session_list.perform(HttpRequest::GET(
-			              cur_stream->url,
-			              {{"Range", "bytes=" + std::to_string(start) + "-" + std::to_string(end - 1)}}))
-			        : session_list.perform(HttpRequest::GET(
-			              cur_stream->url + "&range=" + std::to_string(start) + "-" + std::to_string(end - 1), {}));
-			if (result.redirected_url != "") {
-				cur_stream->url = remove_url_parameter(result.redirected_url, "range");
-			}
+				if (first_not_downloaded_block == read_head_block + forward_buffer_block_num) {
+					continue; // no more room in the cache for this stream
+				}
 
-			if (!result.fail && result.status_code_is_success()) {
-				if (cur_stream->len == 0) {
-					auto content_range_str = result.get_header("Content-Range");
-					char *slash = strchr(content_range_str.c_str(), '/');
-					bool ok = false;
-					if (slash) {
-						char *end;
-						cur_stream->len = strtoll(slash + 1, &end, 10);
-						if (!*end) {
-							ok = true;
-							cur_stream->block_num = NetworkStream::get_block_num(cur_stream->len);
-						} else {
-							logger.error(LOG_THREAD_STR, "failed to parse Content-Range : " + std::string(slash + 1));
-						}
-					} else {
-						logger.error(LOG_THREAD_STR,
-						             "no slash in Content-Range response header : " + content_range_str);
+				// the margin in seconds of playback, so that every stream (and every video) gets the same buffer
+				// -1 (the first to be downloaded) until the decoder has given the time index
+				double margin_seconds = -1;
+				double read_head_time = streams[i]->get_time(read_heads[i]);
+				if (read_head_time >= 0) {
+					margin_seconds =
+					    std::max(0.0, streams[i]->get_time(first_not_downloaded_block * BLOCK_SIZE) - read_head_time);
+					if (margin_seconds >= var_buffer_target_seconds) {
+						streams[i]->buffer_refilling = false;
+					} else if (margin_seconds < std::min(var_buffer_low_water_seconds, var_buffer_target_seconds)) {
+						streams[i]->buffer_refilling = true;
 					}
-					if (!ok) {
-						cur_stream->error = true;
+					if (!streams[i]->buffer_refilling) {
+						continue; // no need to download this stream for now
 					}
 				}
-				if (cur_stream->ready && result.data.size() != expected_len) {
-					logger.error(LOG_THREAD_STR, "size discrepancy : " + std::to_string(expected_len) + " -> " +
-					                                 std::to_string(result.data.size()));
-					if (cur_stream->retry_cnt_left) {
-						cur_stream->retry_cnt_left--;
-					} else {
-						cur_stream->error = true;
+				if (margin_seconds_min > margin_seconds) {
+					margin_seconds_min = margin_seconds;
+					cur_stream_index = i;
+					cur_block = first_not_downloaded_block;
+				}
+			}
+			// nothing is needed for the playback right now : spend the idle time on the blocks at likely seek targets
+			bool prefetch = false;
+			if (cur_stream_index == (size_t)-1) {
+				int prefetch_in_flight_num = 0;
+				for (auto &request : in_flight) {
+					prefetch_in_flight_num += request.second.prefetch;
+				}
+				for (size_t i = 0; i < streams.size() && prefetch_in_flight_num < MAX_PREFETCH_REQUESTS; i++) {
+					if (!streams[i] || streams[i]->error || streams[i]->suspend_request || !streams[i]->ready ||
+					    streams[i]->whole_download || get_in_flight_num(streams[i]) >= max_requests_per_stream) {
+						continue;
 					}
+					for (auto block : streams[i]->prefetch_blocks) {
+						if (!streams[i]->is_block_available(block) && !is_block_in_flight(streams[i], block)) {
+							cur_stream_index = i;
+							cur_block = block;
+							prefetch = true;
+							break;
+						}
+					}
+					if (prefetch) {
+						break;
+					}
+				}
+			}
+			if (cur_stream_index == (size_t)-1) {
+				break;
+			}
+			if (!load_block_from_sd(streams[cur_stream_index], cur_block)) {
+				submit_range_request(streams[cur_stream_index], cur_block, prefetch);
+			}
+		}
+		streams_lock.unlock();
+
+		osTickCounterUpdate(&throughput_timer); // the idle time until here is not counted
+		bool downloading = in_flight.size();
+		u64 received_bytes = 0;
+
+		if (!in_flight.size()) {
+			in_flight_num = 0;
+			wakeup_event.wait((s64)IDLE_WAIT_MS * 1000000);
+			continue;
+		}
+
+		// collect the finished range requests (the streams stay alive as long as they have requests in flight)
+		std::vector<NetworkSessionList *> session_lists;
+		for (auto &request : in_flight) {
+			if (std::find(session_lists.begin(), session_lists.end(), request.first.first) == session_lists.end()) {
+				session_lists.push_back(request.first.first);
+			}
+		}
+		int timeout_ms = NETWORK_WAIT_MS;
+		for (auto session_list : session_lists) {
+			int id;
+			NetworkResult result;
+			while (session_list->wait_any(&id, &result, timeout_ms)) {
+				timeout_ms = 0;
+				auto itr = in_flight.find({session_list, id});
+				if (itr == in_flight.end()) {
 					continue;
 				}
-				cur_stream->retry_cnt_left = NetworkStream::RETRY_CNT_MAX;
-				cur_stream->set_data(block_reading, std::move(result.data)); // data isn't accessed further down so we can move it
-				cur_stream->ready = true;
-			} else if (!result.fail) {
-				logger.error("net/dl", "stream returned: " + std::to_string(result.status_code));
-				cur_stream->error = true;
-			} else {
-				logger.error("net/dl", "access failed : " + result.error);
-				if (cur_stream->retry_cnt_left) {
-					cur_stream->retry_cnt_left--;
+				InFlightRequest request = itr->second;
+				in_flight.erase(itr);
+				if (!result.fail) {
+					received_bytes += result.data.size();
+				}
+				if (request.whole) {
+					on_whole_request_finished(request, result);
 				} else {
-					cur_stream->error = true;
+					on_range_request_finished(request, result);
 				}
+				request.stream->data_event.signal();
 			}
+			timeout_ms = 0;
+		}
+		in_flight_num = in_flight.size();
+		osTickCounterUpdate(&throughput_timer);
+		if (downloading) {
+			add_throughput_sample(received_bytes, osTickCounterRead(&throughput_timer));
 		}
 	}
 	logger.info(LOG_THREAD_STR, "Exit, deiniting...");
+	for (auto &request : in_flight) {
+		request.first.first->cancel(request.first.second);
+	}
+	in_flight.clear();
+	in_flight_num = 0;
 	for (auto stream : streams) {
 		if (stream) {
 			stream->quit_request = true;
@@ -379,6 +912,7 @@ void NetworkStreamDownloader::delete_all() {
 		delete stream;
 		stream = NULL;
 	}
+	block_pool_request_release();
 }
 
 // --------------------------------
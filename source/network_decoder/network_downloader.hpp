@@ -6,21 +6,43 @@
 #include "system/libctru_wrapper.hpp"
 #include "network_io.hpp"
 
+class NetworkStreamDownloader;
+
+// urls starting with this are paths of files on the SD card rather than network urls (e.g. the videos saved offline)
+#define LOCAL_STREAM_URL_PREFIX "file://"
+
 // one instance per one url (once constructed, the url is not changeable)
 struct NetworkStream {
 	static constexpr u64 BLOCK_SIZE = 0x40000; // 256 KiB
 	static constexpr u64 NEW3DS_MAX_CACHE_BLOCKS = 12 * 1000 * 1000 / BLOCK_SIZE;
 	static constexpr u64 OLD3DS_MAX_CACHE_BLOCKS = 4 * 1000 * 1000 / BLOCK_SIZE;
+	static constexpr u64 BACK_WINDOW_BLOCKS = 2; // blocks right before the read head kept for short backward seeks
 	static constexpr int RETRY_CNT_MAX = 1;
+	static constexpr double PREFETCH_SECONDS_BEFORE = 5.0; // a seek lands on the keyframe before the target
 	static u64 get_block_num(u64 size) { return (size + BLOCK_SIZE - 1) / BLOCK_SIZE; }
+	// the number of blocks from the read head to keep downloaded ahead of it
+	static u64 get_forward_window_block_num();
+	// the number of blocks at the prefetch targets kept at most, the part of the cache left by the other windows
+	static u64 get_prefetch_block_num();
 
 	std::string url;
-	Mutex downloaded_data_lock; // std::map needs locking when searching and inserting at the same time
+	Mutex downloaded_data_lock; // the decoder thread reads while the downloader thread writes and evicts
 	u64 len = 0;
 	u64 block_num = 0;
-	std::map<u64, std::vector<u8>> downloaded_data;
+	// the data of downloaded blocks lives in buffers of a pool shared by all the streams
+	std::vector<u8 *> block_data;     // block -> its buffer in the pool, NULL if not downloaded
+	std::vector<u32> block_available; // bitmap of the downloaded blocks
+	std::vector<u64> cached_blocks;   // the blocks holding a buffer, at most MAX_CACHE_BLOCKS
 	bool whole_download = false;
 	NetworkSessionList *session_list = NULL;
+	NetworkStreamDownloader *downloader = NULL; // set by NetworkStreamDownloader::add_stream()
+	// byte offset -> media time anchors taken from the container index the demuxer parsed, sorted by the offset
+	Mutex time_index_lock;
+	std::vector<std::pair<u64, double>> time_index;
+	std::vector<double> prefetch_times; // guarded by `time_index_lock`
+	std::vector<u64> prefetch_blocks;   // the blocks at `prefetch_times`, only used by the downloader thread
+	bool buffer_refilling = true; // false after the buffer target is reached, until it drops below the low-water mark
+	std::string cache_key; // the key of the blocks in the SD card stream cache, decided once the length is known
 
 	// anything above here is not supposed to be used from outside network_downloader.cpp and network_downloader.hpp
 	volatile bool ready = false;
@@ -28,9 +50,11 @@ struct NetworkStream {
 	volatile bool quit_request = false;
 	volatile bool error = false;
 	volatile int retry_cnt_left = RETRY_CNT_MAX;
-	volatile u64 read_head = 0;
+	volatile u64 read_head = 0; // use set_read_head() to modify
 	const char *volatile network_waiting_status = NULL;
+	Event data_event; // signaled each time the downloader is done with a request of this stream (success or not)
 	bool disable_interrupt = false;
+	std::string cache_video_id; // set before add_stream() to have the blocks cached on the SD card, "" not to cache
 	// used for livestreams
 	int seq_head = -1;
 	int seq_id = -1;
@@ -40,9 +64,29 @@ struct NetworkStream {
 
 	// if `whole_download` is true, it will not use Range request but download the whole content at once (used for
 	// livestreams)
-	NetworkStream(std::string url, int64_t len, bool whole_download, NetworkSessionList *session_list)
-	    : url(url), len(len < 0 ? 0 : len), block_num(get_block_num(this->len)), whole_download(whole_download),
-	      session_list(session_list) {}
+	NetworkStream(std::string url, int64_t len, bool whole_download, NetworkSessionList *session_list);
+	~NetworkStream();
+
+	// the data is read from a file on the SD card instead of being downloaded
+	bool is_local() const { return url.compare(0, strlen(LOCAL_STREAM_URL_PREFIX), LOCAL_STREAM_URL_PREFIX) == 0; }
+
+	// `entries` : {byte offset, seconds} pairs, `duration` : the duration of the stream in seconds (< 0 if unknown)
+	void set_time_index(double duration, std::vector<std::pair<u64, double>> entries);
+	// the media time at the byte offset `pos` interpolated between the anchors, or -1 if unknown
+	double get_time(u64 pos);
+	// the byte offset at the media time `time` interpolated between the anchors, or -1 if unknown
+	int64_t get_pos(double time);
+	// `times` : the media times the user is likely to seek to (chapters, the seek bar being dragged...), the most
+	// likely first
+	// the blocks there are downloaded while there is nothing else to download, so that the seek starts right away
+	void set_prefetch_times(const std::vector<double> &times);
+	// recomputes `prefetch_blocks` from the prefetch times and the read head
+	void update_prefetch_blocks();
+
+	// wakes the downloader up if the reader has moved to another block
+	void set_read_head(u64 new_read_head);
+	// waits until the downloader finishes a request of this stream, or `timeout_ms` passes
+	void wait_for_data(int timeout_ms) { data_event.wait((s64)timeout_ms * 1000000); }
 
 	double get_download_percentage();
 	std::vector<double> get_buffering_progress_bar(int res_len);
@@ -50,27 +94,85 @@ struct NetworkStream {
 	// check if the data of the current stream of range [start, start + size) is already downloaded and available
 	bool is_data_available(u64 start, u64 size);
 
-	// this function must only be called when is_data_available(start, size) returns true
-	// returns the data of the stream of range [start, start + size)
-	std::vector<u8> get_data(u64 start, u64 size);
+	// copies the data of the stream of range [start, start + size) into `buf` straight from the cached blocks
+	// stops at the first block not downloaded, and returns the number of bytes copied
+	size_t read_data(u64 start, u64 size, u8 *buf);
+
+	// these functions are supposed to be called from NetworkStreamDownloader::*
+	// is_block_available() does not lock as the downloader thread is the only one modifying the cache
+	bool is_block_available(u64 block) {
+		return block < block_data.size() && (block_available[block / 32] >> (block % 32) & 1);
+	}
+	// returns false if the block could not be stored (the cache is full of blocks more worth keeping)
+	bool set_data(u64 block, const u8 *data, size_t size);
 
-	// this function is supposed to be called from NetworkStreamDownloader::*
-	void set_data(u64 block, std::vector<u8> data);
+  private:
+	// retention policy : lower is evicted first, the pinned blocks are never evicted
+	int get_retention_rank(u64 block, u64 *distance);
+	void release_block(u64 block);
+	// gives up the block least worth keeping (among those of this stream if `own_only`, of every stream sharing the
+	// pool otherwise) to make room for `block`, returns false if all of them are more worth keeping than `block`
+	// called from the downloader thread with `downloaded_data_lock` held
+	bool evict_block_for(u64 block, bool own_only);
 };
 
 // each instance of this class is paired with one downloader thread
 // it owns NetworkStream instances, and the one with the least margin (as in proportion to the length of the entire
 // stream) is the target of next downloading
+// several range requests are kept in flight per stream so that the round trip of each one does not limit the speed
 class NetworkStreamDownloader {
   private:
 	static constexpr u64 BLOCK_SIZE = NetworkStream::BLOCK_SIZE;
 	static constexpr const char *USER_AGENT = "Mozilla/5.0 (Linux; Android 11; Pixel 3a) AppleWebKit/537.36 (KHTML, "
 	                                          "like Gecko) Chrome/83.0.4103.101 Mobile Safari/537.36";
 
+	static constexpr int NEW3DS_MAX_REQUESTS_PER_STREAM = 4;
+	static constexpr int OLD3DS_MAX_REQUESTS_PER_STREAM = 2;
+	static constexpr int MAX_PREFETCH_REQUESTS = 1; // in total, so that prefetching never takes much bandwidth
+
 	Mutex streams_lock;
 	std::vector<NetworkStream *> streams;
 
+	// range requests submitted and not finished yet, keyed by {session list, id returned by submit()}
+	struct InFlightRequest {
+		NetworkStream *stream;
+		u64 block;
+		u64 expected_len; // 0 if the length is not to be checked (the length of the stream is not known yet)
+		bool prefetch;    // speculatively downloading a block at a prefetch target
+		bool whole;       // downloading the whole content of a `whole_download` stream
+	};
+	std::map<std::pair<NetworkSessionList *, int>, InFlightRequest> in_flight;
+	volatile size_t in_flight_num = 0; // in_flight.size() for other threads
+	int max_requests_per_stream = 0;   // 0 : decided by the model
+
+	// throughput measurement
+	Mutex throughput_lock;
+	u64 downloaded_bytes = 0;       // bytes received by range requests
+	double downloading_time_ms = 0; // time spent with at least one range request in flight
+	double recent_throughput = 0;   // bytes/s of the last completed window
+	double throughput_estimate = 0; // EWMA of the windows, 0 until the first window completes
+	u64 recent_window_bytes = 0;
+	double recent_window_time_ms = 0;
+
+	std::vector<u8> sd_read_buffer; // reused by load_block_from_sd()
+
 	bool thread_exit_requested = false;
+	Event wakeup_event; // signaled when there may be something new to download
+
+	int get_max_requests_per_stream();
+	bool is_block_in_flight(NetworkStream *stream, u64 block);
+	int get_in_flight_num(NetworkStream *stream);
+	void submit_range_request(NetworkStream *stream, u64 block, bool prefetch = false);
+	// requests of livestream fragments run in parallel with each other and with the range requests
+	void submit_whole_request(NetworkStream *stream);
+	// fills the block from the file of a local stream or from the SD card stream cache without any request
+	// returns false if it has to be downloaded
+	bool load_block_from_sd(NetworkStream *stream, u64 block);
+	// cancels those out of the window, except the prefetches of blocks still at a prefetch target
+	void cancel_requests(NetworkStream *stream, u64 window_start, u64 window_end);
+	void on_range_request_finished(const InFlightRequest &request, NetworkResult &result);
+	void on_whole_request_finished(const InFlightRequest &request, NetworkResult &result);
+	void add_throughput_sample(u64 bytes, double elapsed_ms);
 
   public:
 	NetworkStreamDownloader() = default;
@@ -78,9 +180,26 @@ class NetworkStreamDownloader {
 	// the pointer must be one that has been new-ed : it will be deleted once quit_request is made
 	void add_stream(NetworkStream *stream);
 
-	void request_thread_exit() { thread_exit_requested = true; }
+	void request_thread_exit() {
+		thread_exit_requested = true;
+		wake_up();
+	}
+	// makes the downloader thread reconsider what to download now, instead of after its current wait times out
+	void wake_up();
+	// deletes the streams left after the thread exits, and releases the block pool
 	void delete_all();
 
+	// the number of range requests kept in flight for each stream (multiplexed over one connection with HTTP/2)
+	// 0 resets it to the default for the model
+	void set_max_requests_per_stream(int num) { max_requests_per_stream = num; }
+	// average download speed in bytes/s while at least one range request is in flight, all the time and recently
+	double get_throughput();
+	double get_recent_throughput();
+	// exponentially weighted moving average of the recent throughput in bytes/s, 0 if nothing has been measured yet
+	// used to decide the video quality
+	double get_estimated_throughput();
+	size_t get_requests_in_flight_num() { return in_flight_num; }
+
 	void downloader_thread();
 };
 // 'arg' should be a pointer to an instance of NetworkStreamDownloader
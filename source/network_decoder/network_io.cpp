@@ -15,6 +15,32 @@ static volatile bool exiting = false;
 
 static std::vector<NetworkSessionList *> deinit_list;
 
+// DNS cache and TLS session cache shared by all the session lists (i.e. all the threads)
+// the connection cache is not shared : libcurl 7.82 documents that sharing it between concurrent threads is unsafe
+static Mutex curl_share_init_lock;
+static CURLSH *curl_share = NULL;
+static Mutex curl_share_locks[CURL_LOCK_DATA_LAST];
+static void curl_share_lock_func(CURL *, curl_lock_data data, curl_lock_access, void *) {
+	curl_share_locks[data].lock();
+}
+static void curl_share_unlock_func(CURL *, curl_lock_data data, void *) { curl_share_locks[data].unlock(); }
+static CURLSH *get_curl_share() {
+	curl_share_init_lock.lock();
+	if (!curl_share) {
+		curl_share = curl_share_init();
+		curl_share_setopt(curl_share, CURLSHOPT_LOCKFUNC, curl_share_lock_func);
+		curl_share_setopt(curl_share, CURLSHOPT_UNLOCKFUNC, curl_share_unlock_func);
+		curl_share_setopt(curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+		curl_share_setopt(curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+	}
+	curl_share_init_lock.unlock();
+	return curl_share;
+}
+
+static Mutex connection_stats_lock;
+static NetworkConnectionStats connection_stats;
+static int foreground_transfer_num = 0; // also guarded by `connection_stats_lock`
+
 void NetworkSessionList::init() {
 	inited = true;
 	deinit_list.push_back(this);
@@ -23,6 +49,15 @@ void NetworkSessionList::deinit() {
 	inited = false;
 
 	// curl cleanup
+	for (auto &request : curl_requests) {
+		curl_release_request(request);
+	}
+	curl_requests.clear();
+	async_finished.clear();
+	for (auto curl : curl_handle_pool) {
+		curl_easy_cleanup(curl);
+	}
+	curl_handle_pool.clear();
 	if (curl_multi) {
 		curl_multi_cleanup(curl_multi);
 		curl_multi = NULL;
@@ -34,6 +69,23 @@ void NetworkSessionList::at_exit() {
 		session_list->deinit();
 	}
 	deinit_list.clear();
+
+	if (curl_share) {
+		curl_share_cleanup(curl_share);
+		curl_share = NULL;
+	}
+}
+NetworkConnectionStats NetworkSessionList::get_connection_stats() {
+	connection_stats_lock.lock();
+	NetworkConnectionStats res = connection_stats;
+	connection_stats_lock.unlock();
+	return res;
+}
+int NetworkSessionList::get_foreground_transfer_num() {
+	connection_stats_lock.lock();
+	int res = foreground_transfer_num;
+	connection_stats_lock.unlock();
+	return res;
 }
 
 static std::string remove_leading_whitespaces(std::string str) {
@@ -115,13 +167,20 @@ static int curl_debug_callback_func(CURL *handle, curl_infotype type, char *data
 	return 0;
 }
 
-void NetworkSessionList::curl_add_request(const HttpRequest &request, NetworkResult *res) {
+void NetworkSessionList::curl_add_request(const HttpRequest &request, NetworkResult *res, int index) {
 	if (!curl_multi) {
 		curl_multi = curl_multi_init();
 		curl_multi_setopt(curl_multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
 	}
 	CURL *curl;
-	curl = curl_easy_init();
+	if (curl_handle_pool.size()) {
+		curl = curl_handle_pool.back();
+		curl_handle_pool.pop_back();
+		curl_easy_reset(curl); // keeps the share and the session ID cache
+	} else {
+		curl = curl_easy_init();
+	}
+	curl_easy_setopt(curl, CURLOPT_SHARE, get_curl_share());
 	curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
 	curl_easy_setopt(curl, CURLOPT_BUFFERSIZE, 102400L);
 	curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "br");
@@ -154,91 +213,229 @@ void NetworkSessionList::curl_add_request(const HttpRequest &request, NetworkRes
 	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, request_headers_list);
 
 	curl_multi_add_handle(curl_multi, curl);
-	curl_requests.push_back({curl, res, curl_errbuf, request.url, request.on_finish});
+	RequestInternal request_internal;
+	request_internal.curl = curl;
+	request_internal.res = res;
+	request_internal.errbuf = curl_errbuf;
+	request_internal.headers_list = request_headers_list;
+	request_internal.orig_url = request.url;
+	request_internal.on_finish = request.on_finish;
+	request_internal.cancel_token = request.cancel_token ? request.cancel_token : this->cancel_token;
+	request_internal.index = index;
+	curl_requests.push_back(std::move(request_internal));
+	if (!background) {
+		connection_stats_lock.lock();
+		foreground_transfer_num++;
+		connection_stats_lock.unlock();
+	}
 }
-CURLMcode NetworkSessionList::curl_perform_requests() {
-	auto read_multi_info = [this]() {
-		CURLMsg *msg;
-		int msg_left;
-		while ((msg = curl_multi_info_read(curl_multi, &msg_left))) {
-			if (msg->msg == CURLMSG_DONE) {
-				CURL *curl = msg->easy_handle;
-
-				int request_index = -1;
-				for (size_t i = 0; i < curl_requests.size(); i++) {
-					if (curl_requests[i].curl == msg->easy_handle) {
-						request_index = i;
-						break;
-					}
+void NetworkSessionList::curl_release_request(RequestInternal &request) {
+	if (!background) {
+		connection_stats_lock.lock();
+		foreground_transfer_num--;
+		connection_stats_lock.unlock();
+	}
+	free(request.errbuf);
+	curl_multi_remove_handle(curl_multi, request.curl);
+	curl_slist_free_all(request.headers_list);
+	if (curl_handle_pool.size() < CURL_HANDLE_POOL_MAX) {
+		curl_handle_pool.push_back(request.curl);
+	} else {
+		curl_easy_cleanup(request.curl);
+	}
+}
+bool NetworkSessionList::curl_finish_request(size_t request_index) {
+	RequestInternal &req = curl_requests[request_index];
+	req.finished = true;
+	if (req.on_finish) {
+		// the callback may submit requests and reallocate `curl_requests`, so nothing in it is touched meanwhile
+		CURL *curl = req.curl;
+		HttpRequest::on_finish_callback_t on_finish = req.on_finish;
+		on_finish(*req.res, req.index);
+		for (request_index = 0; request_index < curl_requests.size(); request_index++) {
+			if (curl_requests[request_index].curl == curl) {
+				break;
+			}
+		}
+		if (request_index == curl_requests.size()) {
+			return false;
+		}
+	}
+	RequestInternal &finished = curl_requests[request_index];
+	if (!finished.async) {
+		return false;
+	}
+	// hand the result over and free the handle right away
+	async_finished.push_back({finished.index, std::move(finished.owned_result)});
+	curl_release_request(finished);
+	curl_requests.erase(curl_requests.begin() + request_index);
+	return true;
+}
+void NetworkSessionList::curl_read_multi_info() {
+	CURLMsg *msg;
+	int msg_left;
+	while ((msg = curl_multi_info_read(curl_multi, &msg_left))) {
+		if (msg->msg == CURLMSG_DONE) {
+			CURL *curl = msg->easy_handle;
+
+			int request_index = -1;
+			for (size_t i = 0; i < curl_requests.size(); i++) {
+				if (curl_requests[i].curl == msg->easy_handle) {
+					request_index = i;
+					break;
 				}
-				// Util_log_save("bench", "finished #" + std::to_string(request_index));
+			}
+			// Util_log_save("bench", "finished #" + std::to_string(request_index));
 
-				if (request_index == -1) {
-					logger.error("curl", "unexpected : while processing multi message corresponding request not found");
-					continue;
+			if (request_index == -1) {
+				logger.error("curl", "unexpected : while processing multi message corresponding request not found");
+				continue;
+			}
+			RequestInternal &req = curl_requests[request_index];
+			NetworkResult &res = *req.res;
+
+			CURLcode each_result = msg->data.result;
+			if (each_result == CURLE_OK) {
+				long status_code;
+				curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status_code);
+				res.status_code = status_code;
+
+				char *redirected_url;
+				curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &redirected_url);
+				res.redirected_url = redirected_url;
+				if (res.redirected_url != req.orig_url) {
+					logger.info("curl", "redir : " + res.redirected_url);
 				}
-				RequestInternal &req = curl_requests[request_index];
-				NetworkResult &res = *req.res;
-
-				CURLcode each_result = msg->data.result;
-				if (each_result == CURLE_OK) {
-					long status_code;
-					curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status_code);
-					res.status_code = status_code;
-
-					char *redirected_url;
-					curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &redirected_url);
-					res.redirected_url = redirected_url;
-					if (res.redirected_url != req.orig_url) {
-						logger.info("curl", "redir : " + res.redirected_url);
+
+				long connect_num = 0;
+				curl_off_t appconnect_time = 0;
+				curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connect_num);
+				curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &appconnect_time);
+				connection_stats_lock.lock();
+				if (connect_num) {
+					connection_stats.new_connections++;
+					if (appconnect_time > 0) {
+						connection_stats.tls_handshakes++;
 					}
 				} else {
-					logger.error("curl",
-					             std::string("deep fail : ") + curl_easy_strerror(each_result) + " / " + req.errbuf);
-					res.fail = true;
-					res.error = req.errbuf;
-				}
-				if (req.on_finish) {
-					req.on_finish(res, request_index);
+					connection_stats.reused_connections++;
 				}
+				connection_stats_lock.unlock();
+			} else {
+				logger.error("curl", std::string("deep fail : ") + curl_easy_strerror(each_result) + " / " + req.errbuf);
+				res.fail = true;
+				res.error = req.errbuf;
 			}
+			curl_finish_request(request_index);
+		}
+	}
+}
+void NetworkSessionList::curl_abort_cancelled_requests() {
+	for (size_t i = 0; i < curl_requests.size();) {
+		RequestInternal &req = curl_requests[i];
+		if (req.finished || !req.cancel_token || !req.cancel_token->is_cancelled()) {
+			i++;
+			continue;
 		}
+		// detach it from the multi handle now so that its stream/connection is given up immediately
+		curl_multi_remove_handle(curl_multi, req.curl);
+		req.res->fail = true;
+		req.res->error = "cancelled";
+		if (!curl_finish_request(i)) {
+			i++;
+		}
+	}
+}
+CURLMcode NetworkSessionList::curl_perform_requests() {
+	// submitted requests may share the multi handle, so only wait for the ones of the current batch
+	auto get_unfinished_num = [this]() {
+		int res = 0;
+		for (auto &i : curl_requests) {
+			res += !i.async && !i.finished;
+		}
+		return res;
 	};
-
 	int running_request_num;
 	do {
+		curl_abort_cancelled_requests();
+		if (!get_unfinished_num()) {
+			break;
+		}
 		CURLMcode res = curl_multi_perform(curl_multi, &running_request_num);
 		if (res) {
 			std::string err = curl_multi_strerror(res);
 			logger.error("curl", "curl multi deep fail : " + err);
 			for (auto &i : curl_requests) {
+				if (i.async) {
+					continue;
+				}
 				i.res->fail = true;
 				i.res->error = err;
 			}
 			return res;
 		}
 		if (running_request_num) {
-			curl_multi_poll(curl_multi, NULL, 0, 10000, NULL);
+			curl_multi_poll(curl_multi, NULL, 0, NETWORK_CANCEL_CHECK_INTERVAL_MS, NULL);
 		}
 		if (exiting) {
 			for (auto &i : curl_requests) {
+				if (i.async) {
+					continue;
+				}
 				i.res->fail = true;
 				i.res->error = "The app is exiting";
 			}
 			return CURLM_OK;
 		}
-		read_multi_info();
-	} while (running_request_num > 0);
+		curl_read_multi_info();
+	} while (running_request_num > 0 && get_unfinished_num() > 0);
 
 	return CURLM_OK;
 }
+void NetworkSessionList::curl_perform_async_requests(int timeout_ms) {
+	if (!curl_multi) {
+		return;
+	}
+	curl_abort_cancelled_requests();
+	int running_request_num;
+	CURLMcode res = curl_multi_perform(curl_multi, &running_request_num);
+	if (!res) {
+		curl_read_multi_info();
+		if (!async_finished.size() && running_request_num && timeout_ms > 0) {
+			curl_multi_poll(curl_multi, NULL, 0, std::min(timeout_ms, NETWORK_CANCEL_CHECK_INTERVAL_MS), NULL);
+			res = curl_multi_perform(curl_multi, &running_request_num);
+			if (!res) {
+				curl_read_multi_info();
+			}
+		}
+	}
+	if (res || exiting) {
+		std::string err = res ? curl_multi_strerror(res) : "The app is exiting";
+		if (res) {
+			logger.error("curl", "curl multi deep fail : " + err);
+		}
+		for (size_t i = 0; i < curl_requests.size();) {
+			if (curl_requests[i].async) {
+				curl_requests[i].res->fail = true;
+				curl_requests[i].res->error = err;
+				async_finished.push_back({curl_requests[i].index, std::move(curl_requests[i].owned_result)});
+				curl_release_request(curl_requests[i]);
+				curl_requests.erase(curl_requests.begin() + i);
+			} else {
+				i++;
+			}
+		}
+	}
+}
 void NetworkSessionList::curl_clear_requests() {
-	for (auto &i : curl_requests) {
-		free(i.errbuf);
-		curl_multi_remove_handle(curl_multi, i.curl);
-		curl_easy_cleanup(i.curl);
+	for (size_t i = 0; i < curl_requests.size();) {
+		if (!curl_requests[i].async) {
+			curl_release_request(curl_requests[i]);
+			curl_requests.erase(curl_requests.begin() + i);
+		} else {
+			i++;
+		}
 	}
-	curl_requests.clear();
 }
 
 NetworkResult NetworkSessionList::perform(const HttpRequest &request) {
@@ -250,7 +447,7 @@ NetworkResult NetworkSessionList::perform(const HttpRequest &request) {
 		return result;
 	}
 
-	this->curl_add_request(request, &result);
+	this->curl_add_request(request, &result, 0);
 	this->curl_perform_requests();
 	this->curl_clear_requests();
 	return result;
@@ -267,13 +464,117 @@ std::vector<NetworkResult> NetworkSessionList::perform(const std::vector<HttpReq
 	}
 
 	for (size_t i = 0; i < requests.size(); i++) {
-		this->curl_add_request(requests[i], &results[i]);
+		this->curl_add_request(requests[i], &results[i], i);
 	}
 	this->curl_perform_requests();
 	this->curl_clear_requests();
 	return results;
 }
 
+int NetworkSessionList::submit(const HttpRequest &request) {
+	int id = async_id_next++;
+	std::unique_ptr<HttpRequest> owned_request(new HttpRequest(request));
+	std::unique_ptr<NetworkResult> owned_result(new NetworkResult());
+
+	if (!this->inited) {
+		owned_result->fail = true;
+		owned_result->error = "invalid session list";
+		async_finished.push_back({id, std::move(owned_result)});
+		return id;
+	}
+
+	this->curl_add_request(*owned_request, owned_result.get(), id);
+	RequestInternal &request_internal = curl_requests.back();
+	request_internal.async = true;
+	request_internal.owned_request = std::move(owned_request);
+	request_internal.owned_result = std::move(owned_result);
+	return id;
+}
+bool NetworkSessionList::poll(int *id, NetworkResult *result) { return wait_any(id, result, 0); }
+bool NetworkSessionList::wait_any(int *id, NetworkResult *result, int timeout_ms) {
+	if (!async_finished.size()) {
+		this->curl_perform_async_requests(timeout_ms);
+	}
+	if (!async_finished.size()) {
+		return false;
+	}
+	if (id) {
+		*id = async_finished.front().first;
+	}
+	if (result) {
+		*result = std::move(*async_finished.front().second);
+	}
+	async_finished.pop_front();
+	return true;
+}
+void NetworkSessionList::cancel(int id) {
+	for (size_t i = 0; i < curl_requests.size(); i++) {
+		if (curl_requests[i].async && curl_requests[i].index == id) {
+			curl_release_request(curl_requests[i]);
+			curl_requests.erase(curl_requests.begin() + i);
+			return;
+		}
+	}
+	for (auto itr = async_finished.begin(); itr != async_finished.end(); itr++) {
+		if (itr->first == id) {
+			async_finished.erase(itr);
+			return;
+		}
+	}
+}
+size_t NetworkSessionList::get_submitted_num() {
+	size_t res = async_finished.size();
+	for (auto &i : curl_requests) {
+		res += i.async;
+	}
+	return res;
+}
+
+void NetworkSessionList::wakeup() {
+	CURLM *multi = curl_multi; // created lazily by the owner thread
+	if (multi) {
+		curl_multi_wakeup(multi);
+	}
+}
+
+std::vector<NetworkResult> HttpRequestGraph::perform(NetworkSessionList &session_list) {
+	std::vector<NetworkResult> results(nodes.size());
+	std::vector<bool> finished(nodes.size(), false);
+	size_t finished_num = 0;
+
+	// dependencies always point to earlier nodes, so each round finishes at least the first unfinished node
+	while (finished_num < nodes.size()) {
+		std::vector<int> batch;
+		for (size_t i = 0; i < nodes.size(); i++) {
+			if (finished[i]) {
+				continue;
+			}
+			bool ready = true;
+			for (auto dependency : nodes[i].dependencies) {
+				if (!finished[dependency]) {
+					ready = false;
+					break;
+				}
+			}
+			if (ready) {
+				batch.push_back(i);
+			}
+		}
+
+		std::vector<HttpRequest> requests;
+		for (auto i : batch) {
+			requests.push_back(nodes[i].build(results));
+		}
+		auto batch_results = session_list.perform(requests);
+		for (size_t i = 0; i < batch.size(); i++) {
+			results[batch[i]] = std::move(batch_results[i]);
+			finished[batch[i]] = true;
+			finished_num++;
+		}
+	}
+	return results;
+}
+
 std::string NetworkResult::get_header(std::string key) {
 	for (auto &c : key) {
 		c = tolower(c);
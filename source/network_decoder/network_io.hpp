@@ -3,6 +3,8 @@
 #include <map>
 #include <string>
 #include <functional>
+#include <memory>
+#include <deque>
 #include <3ds.h>
 #include <curl/curl.h>
 
@@ -19,6 +21,16 @@ struct NetworkResult {
 	bool status_code_is_success() { return status_code / 100 == 2; }
 	std::string get_header(std::string key);
 };
+// aborts every request it is attached to; one token can be shared by a group of requests
+// cancel() may be called from any thread, the requests notice it within NETWORK_CANCEL_CHECK_INTERVAL_MS
+struct NetworkCancelToken {
+	volatile bool cancelled = false;
+
+	void cancel() { cancelled = true; }
+	bool is_cancelled() const { return cancelled; }
+};
+#define NETWORK_CANCEL_CHECK_INTERVAL_MS 100
+
 struct HttpRequest { // including https
 	std::string method;
 	std::string url;
@@ -30,6 +42,7 @@ struct HttpRequest { // including https
 	progress_callback_t progress_func{};
 	using on_finish_callback_t = std::function<void(NetworkResult &, int)>;
 	on_finish_callback_t on_finish{};
+	std::shared_ptr<NetworkCancelToken> cancel_token{}; // NULL : use the token of the session list, if any
 
 	static std::map<std::string, std::string> default_headers_added(std::map<std::string, std::string> headers) {
 		// Set up default Android/YouTube client headers
@@ -59,21 +72,30 @@ struct HttpRequest { // including https
 	}
 
 	HttpRequest with_progress_func(progress_callback_t progress_func) const {
-		return HttpRequest{method, url, headers, body, follow_redirect, progress_func, on_finish};
+		return HttpRequest{method, url, headers, body, follow_redirect, progress_func, on_finish, cancel_token};
 	}
 
 	HttpRequest with_on_finish_callback(on_finish_callback_t on_finish) const {
-		return HttpRequest{method, url, headers, body, follow_redirect, progress_func, on_finish};
+		return HttpRequest{method, url, headers, body, follow_redirect, progress_func, on_finish, cancel_token};
 	}
+
+	HttpRequest with_cancel_token(std::shared_ptr<NetworkCancelToken> cancel_token) const {
+		return HttpRequest{method, url, headers, body, follow_redirect, progress_func, on_finish, cancel_token};
+	}
+};
+
+// process-wide counters of how transfers got their connection
+struct NetworkConnectionStats {
+	u64 reused_connections = 0; // transfers that went over an already established connection
+	u64 new_connections = 0;    // transfers that had to open a new connection
+	u64 tls_handshakes = 0;     // new connections that also went through a TLS handshake
 };
 
 struct NetworkSessionList { // one instance per thread
   private:
-	void deinit(); // will be called for each instance when the app exits
+	static constexpr size_t CURL_HANDLE_POOL_MAX = 8;
 
-	void curl_add_request(const HttpRequest &request, NetworkResult *res);
-	CURLMcode curl_perform_requests();
-	void curl_clear_requests();
+	void deinit(); // will be called for each instance when the app exits
 
   public:
 	// used for libcurl
@@ -82,23 +104,99 @@ struct NetworkSessionList { // one instance per thread
 		CURL *curl;
 		NetworkResult *res;
 		char *errbuf;
+		struct curl_slist *headers_list;
 		std::string orig_url;
 		HttpRequest::on_finish_callback_t on_finish;
+		std::shared_ptr<NetworkCancelToken> cancel_token;
+		int index;          // index in the perform() batch, or the id returned by submit()
+		bool async = false; // submitted via submit() : `owned_*` are set and the request outlives perform() calls
+		bool finished = false;
+		std::unique_ptr<HttpRequest> owned_request; // curl keeps pointers into the request (body etc.)
+		std::unique_ptr<NetworkResult> owned_result;
 	};
 	std::vector<RequestInternal> curl_requests; // {curl context, corresponding result, error buffer}
+	std::vector<CURL *> curl_handle_pool;       // finished easy handles kept for reuse (curl_easy_reset()-ed)
+	// finished submitted requests not yet picked up by poll()/wait_any()
+	std::deque<std::pair<int, std::unique_ptr<NetworkResult>>> async_finished;
+	int async_id_next = 0;
+	// attached to the requests that do not carry a token of their own
+	std::shared_ptr<NetworkCancelToken> cancel_token;
+
+  private:
+	void curl_add_request(const HttpRequest &request, NetworkResult *res, int index);
+	void curl_release_request(RequestInternal &request);
+	// marks the request finished and runs its callback, then releases it if it was submitted via submit()
+	// returns true if it has been removed from `curl_requests`
+	bool curl_finish_request(size_t request_index);
+	void curl_read_multi_info();
+	void curl_abort_cancelled_requests();
+	CURLMcode curl_perform_requests();
+	void curl_perform_async_requests(int timeout_ms);
+	void curl_clear_requests();
 
+  public:
 	volatile bool inited = false;
+	// the requests of a background list are not counted by get_foreground_transfer_num()
+	bool background = false;
 
 	// this function does NOT perform any network/socket related operations
 	void init();
 	void close_sessions();
+	// requests performed or submitted after this call without a token of their own are aborted by `token` (can be NULL)
+	void set_cancel_token(std::shared_ptr<NetworkCancelToken> token) { cancel_token = token; }
 
 	// network operations
 	NetworkResult perform(const HttpRequest &request);
 	std::vector<NetworkResult> perform(const std::vector<HttpRequest> &requests);
 
+	// asynchronous interface, sharing the multi handle (and the connections) with perform()
+	// submitted requests keep running during later poll()/wait_any()/perform() calls on this instance
+	// returns the id of the request, which is passed to `on_finish` as its second argument
+	int submit(const HttpRequest &request);
+	// drives the submitted transfers without blocking
+	// returns true and stores the id and the result of one finished request if there is any
+	bool poll(int *id, NetworkResult *result);
+	// same as poll(), but waits up to `timeout_ms` for a submitted request to finish
+	bool wait_any(int *id, NetworkResult *result, int timeout_ms);
+	// aborts a submitted request (or discards its result if it has already finished)
+	void cancel(int id);
+	// the number of submitted requests whose results have not been picked up yet
+	size_t get_submitted_num();
+	// makes a perform()/wait_any() waiting for the network on another thread return to its caller's loop early
+	// (a no-op if libcurl cannot wake the poll on this platform; the waits are bounded anyway)
+	void wakeup();
+
 	static void at_exit();
 	static void exit_request();
+	static NetworkConnectionStats get_connection_stats();
+	// the number of requests in progress on all the session lists other than the background ones
+	// background work is supposed to wait while this is not 0
+	static int get_foreground_transfer_num();
+};
+
+// a set of requests where some of them can only be built from the results of others
+// every request whose dependencies have all finished is sent in the same multiplexed batch,
+// so only actual data dependencies cost an extra round trip
+struct HttpRequestGraph {
+	// `results` holds the results of all the requests added so far; only those listed as dependencies are finished
+	using request_builder_t = std::function<HttpRequest(std::vector<NetworkResult> &results)>;
+	struct Node {
+		std::vector<int> dependencies;
+		request_builder_t build;
+	};
+	std::vector<Node> nodes;
+
+	// returns the index of the request, which is also the index of its result in the vector returned by perform()
+	int add(const HttpRequest &request) {
+		return add({}, [request](std::vector<NetworkResult> &) { return request; });
+	}
+	// every request in `dependencies` must already have been added (so the graph is never cyclic)
+	int add(const std::vector<int> &dependencies, request_builder_t build) {
+		nodes.push_back({dependencies, build});
+		return nodes.size() - 1;
+	}
+
+	std::vector<NetworkResult> perform(NetworkSessionList &session_list);
 };
 
 void lock_network_state();
@@ -0,0 +1,549 @@
+#include "headers.hpp"
+#include "offline_download.hpp"
+#include "network_downloader.hpp"
+#include "network_io.hpp"
+#include "system/file.hpp"
+#include "util/async_task.hpp"
+#include "rapidjson_wrapper.hpp"
+
+using namespace rapidjson;
+
+#define OFFLINE_DOWNLOAD_VERSION 0
+#define OFFLINE_DOWNLOAD_DIR (DEF_MAIN_DIR + "downloads/")
+#define OFFLINE_QUEUE_PATH (OFFLINE_DOWNLOAD_DIR + "queue.json")
+#define OFFLINE_QUEUE_TMP_PATH (OFFLINE_DOWNLOAD_DIR + "queue_tmp.json")
+
+#define BLOCK_SIZE NetworkStream::BLOCK_SIZE
+#define FOREGROUND_POLL_MS 100
+#define FOREGROUND_IDLE_WAIT_MS 500 // the other transfers must have been idle for this long before each block
+#define RETRY_WAIT_MS 5000
+#define MAX_CONSECUTIVE_FAILURES 5
+#define MAX_URL_REFRESH_CNT 2 // per app run
+
+#define LOG_THREAD_STR "offline-dl"
+
+static constexpr int VIDEO = 0;
+static constexpr int AUDIO = 1;
+
+struct OfflineStream {
+	std::string url;
+	u64 len = 0;
+	std::vector<u8> block_saved; // 1 if the block is already in the file
+	u64 saved_num = 0;
+
+	u64 get_block_num() const { return NetworkStream::get_block_num(len); }
+	bool is_completed() const { return saved_num == get_block_num(); }
+};
+struct OfflineDownload {
+	u32 serial = 0; // tells apart an item from the one replacing it with the same id
+	std::string id;
+	std::string title;
+	int quality = 0;
+	OfflineStream streams[2];
+	bool failed = false;
+	bool remove_request = false; // the files are deleted by the download thread, which is the only one touching them
+	bool url_refreshing = false; // the stream urls have expired and are being fetched again
+	int url_refresh_cnt = 0;
+
+	bool is_completed() const { return streams[VIDEO].is_completed() && streams[AUDIO].is_completed(); }
+};
+
+static bool should_be_running = true;
+static Event wakeup_event; // signaled when there may be something new to do
+
+static Mutex items_lock;
+static bool items_loaded = false;
+static std::vector<OfflineDownload> items; // in the order to be downloaded
+static std::string downloading_id;
+static std::string playing_id; // the item whose files are being read by the player, not deleted until it stops
+static u32 serial_next = 0;
+// only used from the download thread
+static NetworkSessionList session_list;
+
+static AtomicFileIO atomic_io(OFFLINE_QUEUE_PATH, OFFLINE_QUEUE_TMP_PATH);
+
+static std::string get_data_path(const std::string &id, int type) {
+	return OFFLINE_DOWNLOAD_DIR + id + (type == VIDEO ? "/video.bin" : "/audio.bin");
+}
+static std::string get_progress_path(const std::string &id, int type) {
+	return OFFLINE_DOWNLOAD_DIR + id + (type == VIDEO ? "/video_progress.bin" : "/audio_progress.bin");
+}
+
+// must be called with `items_lock` held
+static OfflineDownload *find_item(const std::string &id) {
+	for (auto &item : items) {
+		if (item.id == id && !item.remove_request) {
+			return &item;
+		}
+	}
+	return NULL;
+}
+// must be called with `items_lock` held
+static OfflineDownload *find_item_by_serial(u32 serial) {
+	for (auto &item : items) {
+		if (item.serial == serial && !item.remove_request) {
+			return &item;
+		}
+	}
+	return NULL;
+}
+
+// must be called with `items_lock` held
+static void confirm_items_loaded() {
+	if (items_loaded) {
+		return;
+	}
+	items_loaded = true;
+
+	auto tmp = atomic_io.load([](const std::string &data) {
+		Document json_root;
+		std::string error;
+		RJson data_json = RJson::parse(json_root, data.c_str(), error);
+		return data_json.has_key("version") && data_json["version"].int_value() >= 0;
+	});
+	if (tmp.first.code != 0) {
+		logger.info(LOG_THREAD_STR, "no download queue saved yet");
+		return;
+	}
+
+	Document json_root;
+	std::string error;
+	RJson data_json = RJson::parse(json_root, tmp.second.c_str(), error);
+	for (auto download : data_json["downloads"].array_items()) {
+		OfflineDownload cur;
+		cur.id = download["id"].string_value();
+		cur.title = download["title"].string_value();
+		cur.quality = download["quality"].int_value();
+		cur.streams[VIDEO].url = download["video_url"].string_value();
+		cur.streams[AUDIO].url = download["audio_url"].string_value();
+		cur.streams[VIDEO].len = strtoull(download["video_len"].string_value().c_str(), NULL, 10);
+		cur.streams[AUDIO].len = strtoull(download["audio_len"].string_value().c_str(), NULL, 10);
+		if (!youtube_is_valid_video_id(cur.id) || !cur.streams[VIDEO].len || !cur.streams[AUDIO].len) {
+			logger.caution(LOG_THREAD_STR, "invalid queue item : " + cur.id);
+			continue;
+		}
+		for (int type = 0; type < 2; type++) {
+			OfflineStream &stream = cur.streams[type];
+			stream.block_saved.assign(stream.get_block_num(), 0);
+			std::vector<u8> progress;
+			Path(get_progress_path(cur.id, type)).read_entire_file(progress);
+			// a progress file cut short by a power loss only loses the blocks after it
+			for (size_t i = 0; i < std::min(progress.size(), stream.block_saved.size()); i++) {
+				stream.block_saved[i] = progress[i] ? 1 : 0;
+				stream.saved_num += stream.block_saved[i];
+			}
+		}
+		cur.serial = serial_next++;
+		items.push_back(cur);
+	}
+	logger.info(LOG_THREAD_STR, "loaded the queue (" + std::to_string(items.size()) + " items)");
+}
+
+static void save_items() {
+	items_lock.lock();
+	Document json_root;
+	auto &allocator = json_root.GetAllocator();
+
+	json_root.SetObject();
+	json_root.AddMember("version", Value(OFFLINE_DOWNLOAD_VERSION), allocator);
+
+	Value downloads(kArrayType);
+	for (auto &item : items) {
+		if (item.remove_request) {
+			continue;
+		}
+		Value cur_json(kObjectType);
+		cur_json.AddMember("id", item.id, allocator);
+		cur_json.AddMember("title", item.title, allocator);
+		cur_json.AddMember("quality", Value(item.quality), allocator);
+		cur_json.AddMember("video_url", item.streams[VIDEO].url, allocator);
+		cur_json.AddMember("audio_url", item.streams[AUDIO].url, allocator);
+		// string values because we have to deal with u64 values
+		cur_json.AddMember("video_len", std::to_string(item.streams[VIDEO].len), allocator);
+		cur_json.AddMember("audio_len", std::to_string(item.streams[AUDIO].len), allocator);
+		downloads.PushBack(cur_json, allocator);
+	}
+	json_root.AddMember("downloads", downloads, allocator);
+	items_lock.unlock();
+
+	std::string data = RJson(json_root).dump();
+	auto result = atomic_io.save(data);
+	if (result.code != 0) {
+		logger.warning(LOG_THREAD_STR, "failed to save the queue : " + result.string + result.error_description,
+		               result.code);
+	}
+}
+
+bool offline_download_enqueue(const YouTubeVideoDetail &info, int quality) {
+	if (info.is_livestream || !youtube_is_valid_video_id(info.id) || !info.video_stream_urls.count(quality) ||
+	    info.audio_stream_url == "") {
+		return false;
+	}
+	OfflineDownload new_item;
+	new_item.id = info.id;
+	new_item.title = info.title;
+	new_item.quality = quality;
+	new_item.streams[VIDEO].url = info.video_stream_urls.at(quality);
+	new_item.streams[AUDIO].url = info.audio_stream_url;
+	for (int type = 0; type < 2; type++) {
+		OfflineStream &stream = new_item.streams[type];
+		int64_t len = extract_stream_length(stream.url);
+		if (len <= 0) {
+			logger.warning(LOG_THREAD_STR, "stream length unknown : " + info.id);
+			return false;
+		}
+		stream.len = len;
+		stream.block_saved.assign(stream.get_block_num(), 0);
+	}
+
+	items_lock.lock();
+	confirm_items_loaded();
+	if (info.id == playing_id && !find_item(info.id)) {
+		// removed while being played : a new download would overwrite the files being read
+		items_lock.unlock();
+		logger.warning(LOG_THREAD_STR, "removal pending until the playback stops : " + info.id);
+		return false;
+	}
+	OfflineDownload *item = find_item(info.id);
+	bool is_new = !item;
+	if (item) {
+		// retry after a failure, keeping the blocks already saved if it is the same content
+		if (item->quality == quality && item->streams[VIDEO].len == new_item.streams[VIDEO].len &&
+		    item->streams[AUDIO].len == new_item.streams[AUDIO].len) {
+			item->streams[VIDEO].url = new_item.streams[VIDEO].url;
+			item->streams[AUDIO].url = new_item.streams[AUDIO].url;
+			item->failed = false;
+			item->url_refresh_cnt = 0;
+		} else {
+			item->remove_request = true;
+			is_new = true;
+		}
+	}
+	if (is_new) {
+		new_item.serial = serial_next++;
+		items.push_back(new_item);
+	}
+	items_lock.unlock();
+
+	save_items();
+	wakeup_event.signal();
+	return true;
+}
+
+void offline_download_remove(const std::string &video_id) {
+	items_lock.lock();
+	confirm_items_loaded();
+	OfflineDownload *item = find_item(video_id);
+	if (item) {
+		item->remove_request = true;
+	}
+	items_lock.unlock();
+
+	if (item) {
+		save_items();
+		wakeup_event.signal();
+	}
+}
+
+OfflineDownloadStatus offline_download_get_status(const std::string &video_id, double *progress) {
+	OfflineDownloadStatus res = OfflineDownloadStatus::NONE;
+	items_lock.lock();
+	confirm_items_loaded();
+	OfflineDownload *item = find_item(video_id);
+	if (item) {
+		res = item->is_completed()         ? OfflineDownloadStatus::COMPLETED
+		      : item->failed               ? OfflineDownloadStatus::FAILED
+		      : downloading_id == video_id ? OfflineDownloadStatus::DOWNLOADING
+		                                   : OfflineDownloadStatus::QUEUED;
+		if (progress) {
+			u64 total = item->streams[VIDEO].len + item->streams[AUDIO].len;
+			u64 saved = 0;
+			for (int type = 0; type < 2; type++) {
+				saved += std::min(item->streams[type].saved_num * BLOCK_SIZE, item->streams[type].len);
+			}
+			*progress = total ? (double)saved / total * 100 : 0;
+		}
+	}
+	items_lock.unlock();
+	return res;
+}
+
+bool offline_download_get_local_streams(const std::string &video_id, int *quality, std::string *video_url,
+                                        std::string *audio_url) {
+	items_lock.lock();
+	confirm_items_loaded();
+	OfflineDownload *item = find_item(video_id);
+	bool res = item && item->is_completed();
+	if (res) {
+		if (quality) {
+			*quality = item->quality;
+		}
+		if (video_url) {
+			*video_url = LOCAL_STREAM_URL_PREFIX + get_data_path(video_id, VIDEO);
+		}
+		if (audio_url) {
+			*audio_url = LOCAL_STREAM_URL_PREFIX + get_data_path(video_id, AUDIO);
+		}
+	}
+	items_lock.unlock();
+	return res;
+}
+
+void offline_download_set_playing(const std::string &video_id) {
+	items_lock.lock();
+	bool changed = playing_id != video_id;
+	playing_id = video_id;
+	items_lock.unlock();
+	if (changed) {
+		wakeup_event.signal(); // a deferred removal may be processed now
+	}
+}
+
+// run as an async task, because the parser is not supposed to be used from several threads at once
+static void refresh_download_urls(void *arg) {
+	(void)arg;
+	items_lock.lock();
+	std::vector<std::string> ids;
+	for (auto &item : items) {
+		if (item.url_refreshing && !item.remove_request) {
+			ids.push_back(item.id);
+		}
+	}
+	items_lock.unlock();
+
+	for (auto &id : ids) {
+		YouTubeVideoDetail info = youtube_load_video_page(youtube_get_video_url_by_id(id));
+
+		items_lock.lock();
+		OfflineDownload *item = find_item(id);
+		if (item) {
+			item->url_refreshing = false;
+			bool ok = info.error == "" && info.video_stream_urls.count(item->quality) && info.audio_stream_url != "";
+			if (ok) {
+				std::string new_urls[2] = {info.video_stream_urls[item->quality], info.audio_stream_url};
+				for (int type = 0; type < 2; type++) {
+					// a different length means a different encode, with which the saved blocks do not line up
+					ok = ok && extract_stream_length(new_urls[type]) == (int64_t)item->streams[type].len;
+				}
+				if (ok) {
+					item->streams[VIDEO].url = new_urls[VIDEO];
+					item->streams[AUDIO].url = new_urls[AUDIO];
+				}
+			}
+			if (!ok) {
+				logger.warning(LOG_THREAD_STR, "failed to refresh the stream urls : " + id);
+				item->failed = true;
+			}
+		}
+		items_lock.unlock();
+	}
+	save_items();
+	wakeup_event.signal();
+}
+
+// deletes the files of the removed items, must be called from the download thread
+// the removal of the item being played is deferred until the playback stops
+static void process_remove_requests() {
+	items_lock.lock();
+	std::vector<std::string> removed_ids;
+	for (auto itr = items.begin(); itr != items.end();) {
+		if (itr->remove_request && itr->id != playing_id) {
+			std::string id = itr->id;
+			itr = items.erase(itr);
+			// the video may have been enqueued again while the removal was deferred, then the files are its own
+			if (!find_item(id)) {
+				removed_ids.push_back(id);
+			}
+		} else {
+			itr++;
+		}
+	}
+	items_lock.unlock();
+
+	for (auto &id : removed_ids) {
+		for (int type = 0; type < 2; type++) {
+			Path(get_data_path(id, type)).delete_file();
+			Path(get_progress_path(id, type)).delete_file();
+		}
+		logger.info(LOG_THREAD_STR, "removed " + id);
+	}
+}
+
+// returns false if the thread is to exit
+static bool wait_for_foreground_idle() {
+	int idle_ms = 0;
+	while (should_be_running && idle_ms < FOREGROUND_IDLE_WAIT_MS) {
+		if (NetworkSessionList::get_foreground_transfer_num()) {
+			idle_ms = 0;
+		} else {
+			idle_ms += FOREGROUND_POLL_MS;
+		}
+		usleep(FOREGROUND_POLL_MS * 1000);
+	}
+	return should_be_running;
+}
+
+void offline_download_thread_func(void *arg) {
+	(void)arg;
+	session_list.init();
+	session_list.background = true;
+	int consecutive_failures = 0;
+
+	while (should_be_running) {
+		process_remove_requests();
+
+		// the first block not saved yet of the first item not completed yet
+		items_lock.lock();
+		confirm_items_loaded();
+		std::string id;
+		u32 serial = 0;
+		std::string url;
+		int type = -1;
+		u64 block = 0;
+		u64 len = 0;
+		bool fresh = false;
+		for (auto &item : items) {
+			if (item.remove_request || item.failed || item.url_refreshing || item.is_completed()) {
+				continue;
+			}
+			fresh = !item.streams[VIDEO].saved_num && !item.streams[AUDIO].saved_num;
+			if (fresh && item.id == playing_id) {
+				continue; // the files of the item it replaces are being played
+			}
+			for (type = 0; type < 2; type++) {
+				OfflineStream &stream = item.streams[type];
+				if (!stream.is_completed()) {
+					block = std::find(stream.block_saved.begin(), stream.block_saved.end(), 0) -
+					        stream.block_saved.begin();
+					url = stream.url;
+					len = stream.len;
+					break;
+				}
+			}
+			id = item.id;
+			serial = item.serial;
+			break;
+		}
+		downloading_id = id;
+		items_lock.unlock();
+
+		if (id == "") {
+			wakeup_event.wait();
+			continue;
+		}
+		if (!wait_for_foreground_idle()) {
+			break;
+		}
+
+		// the file is created (and the directory with it) before the first block
+		// an item starting fresh may replace one of another quality or length : its files are recreated so that no
+		// trailing bytes of a longer file are left and its progress is not taken for the new one's after a restart
+		std::string data_path = get_data_path(id, type);
+		if (fresh) {
+			for (int cur_type = 0; cur_type < 2; cur_type++) {
+				Path(get_progress_path(id, cur_type)).delete_file();
+				Path(get_data_path(id, cur_type)).write_file(NULL, 0);
+			}
+		} else if (block == 0 && !Path(data_path).is_file()) {
+			Path(data_path).write_file(NULL, 0);
+		}
+
+		u64 start = block * BLOCK_SIZE;
+		u64 end = std::min(start + BLOCK_SIZE, len);
+		int request_id = session_list.submit(
+		    HttpRequest::GET(url + "&range=" + std::to_string(start) + "-" + std::to_string(end - 1), {}));
+		NetworkResult result;
+		bool aborted = false;
+		while (!session_list.wait_any(NULL, &result, FOREGROUND_POLL_MS)) {
+			items_lock.lock();
+			bool removed = !find_item_by_serial(serial);
+			items_lock.unlock();
+			// give the connection up to the foreground right away, the block is downloaded again later
+			if (!should_be_running || removed || NetworkSessionList::get_foreground_transfer_num()) {
+				session_list.cancel(request_id);
+				aborted = true;
+				break;
+			}
+		}
+		if (aborted) {
+			continue;
+		}
+
+		if (!result.fail && result.status_code_is_success() && result.data.size() == end - start) {
+			consecutive_failures = 0;
+			Result_with_string write_result = Path(data_path).write_file_part(result.data.data(), end - start, start);
+			if (write_result.code != 0) {
+				logger.error(LOG_THREAD_STR, "failed to write " + data_path + " : " + write_result.string);
+				items_lock.lock();
+				OfflineDownload *item = find_item_by_serial(serial);
+				if (item) {
+					item->failed = true;
+				}
+				items_lock.unlock();
+				continue;
+			}
+
+			items_lock.lock();
+			OfflineDownload *item = find_item_by_serial(serial);
+			std::vector<u8> progress;
+			bool completed = false;
+			if (item && !item->streams[type].block_saved[block]) {
+				item->streams[type].block_saved[block] = 1;
+				item->streams[type].saved_num++;
+				progress = item->streams[type].block_saved;
+				completed = item->is_completed();
+			}
+			items_lock.unlock();
+
+			if (progress.size()) {
+				Path(get_progress_path(id, type)).write_file(progress.data(), progress.size());
+			}
+			if (completed) {
+				logger.info(LOG_THREAD_STR, "completed " + id);
+			}
+		} else if (!result.fail && result.status_code == HTTP_STATUS_CODE_FORBIDDEN) {
+			// the urls have expired (after some hours, or the app was restarted)
+			items_lock.lock();
+			OfflineDownload *item = find_item_by_serial(serial);
+			bool refresh = false;
+			if (item) {
+				if (item->url_refresh_cnt < MAX_URL_REFRESH_CNT) {
+					item->url_refresh_cnt++;
+					item->url_refreshing = refresh = true;
+				} else {
+					item->failed = true;
+				}
+			}
+			items_lock.unlock();
+			logger.info(LOG_THREAD_STR, "stream urls expired : " + id);
+			if (refresh) {
+				queue_async_task(refresh_download_urls, NULL);
+			}
+		} else {
+			logger.warning(LOG_THREAD_STR, "block download failed : " +
+			                                   (result.fail ? result.error : std::to_string(result.status_code)));
+			if (++consecutive_failures >= MAX_CONSECUTIVE_FAILURES) {
+				consecutive_failures = 0;
+				items_lock.lock();
+				OfflineDownload *item = find_item_by_serial(serial);
+				if (item) {
+					item->failed = true;
+				}
+				items_lock.unlock();
+			} else {
+				wakeup_event.wait((s64)RETRY_WAIT_MS * 1000000);
+			}
+		}
+	}
+
+	items_lock.lock();
+	downloading_id = "";
+	items_lock.unlock();
+
+	logger.info(LOG_THREAD_STR, "Thread exit.");
+	threadExit(0);
+}
+void offline_download_thread_exit_request() {
+	should_be_running = false;
+	wakeup_event.signal();
+}
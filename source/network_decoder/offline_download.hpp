@@ -0,0 +1,35 @@
+#pragma once
+#include <string>
+#include "types.hpp"
+#include "youtube_parser/parser.hpp"
+
+// videos saved in full on the SD card, downloaded one block at a time in the background
+// the progress is saved per block, so an interrupted download resumes where it stopped even after a restart
+// the downloader yields to every other transfer of the app : it only runs while nothing else is being downloaded
+
+enum class OfflineDownloadStatus {
+	NONE,
+	QUEUED,
+	DOWNLOADING,
+	COMPLETED,
+	FAILED, // enqueue it again to retry
+};
+
+// `quality` : a key of `info.video_stream_urls`
+// returns false if the video cannot be saved (livestreams, or the streams are not available)
+bool offline_download_enqueue(const YouTubeVideoDetail &info, int quality);
+// cancels the download, or deletes the saved video
+void offline_download_remove(const std::string &video_id);
+// `progress` (optional) : receives the percentage of the saved data
+OfflineDownloadStatus offline_download_get_status(const std::string &video_id, double *progress = NULL);
+// if the video has been saved completely, returns true with its quality and the urls of the files on the SD card to be
+// passed to NetworkMultipleDecoder::init() (any of the pointers can be NULL)
+bool offline_download_get_local_streams(const std::string &video_id, int *quality, std::string *video_url,
+                                        std::string *audio_url);
+
+// `video_id` : the video being played from its saved files, "" if none
+// the files of that video are kept until it stops being played, even if it is removed meanwhile
+void offline_download_set_playing(const std::string &video_id);
+
+void offline_download_thread_func(void *arg);
+void offline_download_thread_exit_request(void);
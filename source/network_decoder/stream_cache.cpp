@@ -0,0 +1,251 @@
+#include <list>
+#include <deque>
+#include "headers.hpp"
+#include "stream_cache.hpp"
+#include "system/file.hpp"
+
+#define STREAM_CACHE_DIR (DEF_MAIN_DIR + "stream_cache/")
+#define STREAM_CACHE_INDEX_PATH (STREAM_CACHE_DIR + "index.txt")
+#define STREAM_CACHE_INDEX_TMP_PATH (STREAM_CACHE_DIR + "index.tmp")
+// blocks waiting to be written are held in memory, so this many blocks at most
+#define MAX_PENDING_WRITES (var_is_new3ds ? 4 : 2)
+
+static bool should_be_running = true;
+static Event write_event; // signaled when a block is queued or the exit is requested
+
+static Mutex cache_lock;
+static bool index_loaded = false;
+static bool index_dirty = false; // the index on the SD card is outdated
+// {entry name, size}, the least recently used first
+static std::list<std::pair<std::string, u64>> lru_list;
+static std::map<std::string, std::list<std::pair<std::string, u64>>::iterator> entries;
+static std::deque<std::pair<std::string, std::vector<u8>>> pending_writes;
+static StreamCacheStats stats;
+
+static std::string get_entry_name(const std::string &key, u64 block) { return key + "_" + std::to_string(block); }
+
+// must be called with `cache_lock` held
+static void confirm_index_loaded() {
+	if (index_loaded) {
+		return;
+	}
+	index_loaded = true;
+
+	auto loaded = AtomicFileIO(STREAM_CACHE_INDEX_PATH, STREAM_CACHE_INDEX_TMP_PATH)
+	                  .load([](const std::string &data) { return data.empty() || data.back() == '\n'; });
+	if (loaded.first.code != 0) {
+		logger.info("stream-cache", "index not saved yet");
+		return;
+	}
+	const std::string &data = loaded.second;
+	size_t head = 0;
+	while (head < data.size()) {
+		size_t line_end = data.find('\n', head);
+		if (line_end == std::string::npos) {
+			line_end = data.size();
+		}
+		std::string line = data.substr(head, line_end - head);
+		head = line_end + 1;
+
+		size_t space = line.find(' ');
+		if (space == std::string::npos || space == 0) {
+			continue;
+		}
+		std::string name = line.substr(0, space);
+		u64 size = strtoull(line.c_str() + space + 1, NULL, 10);
+		if (!size || entries.count(name)) {
+			continue;
+		}
+		lru_list.push_back({name, size});
+		entries[name] = std::prev(lru_list.end());
+		stats.total_size += size;
+	}
+	logger.info("stream-cache", "loaded index : " + std::to_string(entries.size()) + " blocks, " +
+	                                std::to_string(stats.total_size / 1000000) + " MB");
+}
+
+// must be called with `cache_lock` held
+static void remove_entry(const std::string &name) {
+	auto itr = entries.find(name);
+	if (itr == entries.end()) {
+		return;
+	}
+	stats.total_size -= itr->second->second;
+	lru_list.erase(itr->second);
+	entries.erase(itr);
+	index_dirty = true;
+}
+
+std::string stream_cache_make_key(const std::string &video_id, const std::string &url, u64 len) {
+	if (video_id == "" || !len) {
+		return "";
+	}
+	size_t itag_pos = url.find("itag=");
+	if (itag_pos == std::string::npos || (itag_pos && url[itag_pos - 1] != '?' && url[itag_pos - 1] != '&')) {
+		return "";
+	}
+	itag_pos += std::string("itag=").size();
+	size_t itag_end = itag_pos;
+	while (itag_end < url.size() && isdigit(url[itag_end])) {
+		itag_end++;
+	}
+	if (itag_end == itag_pos) {
+		return "";
+	}
+	return video_id + "_" + url.substr(itag_pos, itag_end - itag_pos) + "_" + std::to_string(len);
+}
+
+bool stream_cache_read(const std::string &key, u64 block, u8 *buf, size_t size) {
+	if (var_stream_cache_size_mb <= 0 || key == "") {
+		return false;
+	}
+	std::string name = get_entry_name(key, block);
+
+	cache_lock.lock();
+	confirm_index_loaded();
+	auto itr = entries.find(name);
+	if (itr == entries.end() || itr->second->second != size) {
+		stats.miss_num++;
+		cache_lock.unlock();
+		return false;
+	}
+	lru_list.splice(lru_list.end(), lru_list, itr->second);
+	index_dirty = true;
+	cache_lock.unlock();
+
+	u32 size_read = 0;
+	Result_with_string result = Path(STREAM_CACHE_DIR + name).read_file(buf, size, size_read);
+
+	cache_lock.lock();
+	bool ok = result.code == 0 && size_read == size;
+	if (ok) {
+		stats.hit_num++;
+	} else {
+		// deleted or broken on the SD card, or evicted by the cache thread in the meantime
+		stats.miss_num++;
+		remove_entry(name);
+	}
+	cache_lock.unlock();
+	return ok;
+}
+
+void stream_cache_write(const std::string &key, u64 block, std::vector<u8> &&data) {
+	if (var_stream_cache_size_mb <= 0 || key == "" || data.empty()) {
+		return;
+	}
+	std::string name = get_entry_name(key, block);
+
+	cache_lock.lock();
+	confirm_index_loaded();
+	bool queued = false;
+	if (!entries.count(name)) {
+		bool already_pending = false;
+		for (auto &pending : pending_writes) {
+			if (pending.first == name) {
+				already_pending = true;
+				break;
+			}
+		}
+		if (!already_pending) {
+			// never make the downloader wait for the SD card
+			if ((int)pending_writes.size() >= MAX_PENDING_WRITES) {
+				stats.dropped_num++;
+			} else {
+				pending_writes.push_back({name, std::move(data)});
+				queued = true;
+			}
+		}
+	}
+	cache_lock.unlock();
+
+	if (queued) {
+		write_event.signal();
+	}
+}
+
+StreamCacheStats stream_cache_get_stats() {
+	cache_lock.lock();
+	StreamCacheStats res = stats;
+	cache_lock.unlock();
+	return res;
+}
+
+static void save_index() {
+	cache_lock.lock();
+	std::string data;
+	for (auto &entry : lru_list) {
+		data += entry.first + " " + std::to_string(entry.second) + "\n";
+	}
+	index_dirty = false;
+	cache_lock.unlock();
+
+	Result_with_string result = AtomicFileIO(STREAM_CACHE_INDEX_PATH, STREAM_CACHE_INDEX_TMP_PATH).save(data);
+	if (result.code != 0) {
+		logger.error("stream-cache", "failed to save the index : " + result.string + result.error_description);
+	}
+}
+
+void stream_cache_thread_func(void *arg) {
+	(void)arg;
+
+	while (should_be_running) {
+		cache_lock.lock();
+		bool has_pending = pending_writes.size();
+		std::pair<std::string, std::vector<u8>> cur;
+		if (has_pending) {
+			cur = std::move(pending_writes.front());
+			pending_writes.pop_front();
+		}
+		bool need_save = !has_pending && index_dirty;
+		cache_lock.unlock();
+
+		if (!has_pending) {
+			if (need_save) {
+				save_index();
+			}
+			write_event.wait();
+			continue;
+		}
+
+		Result_with_string result = Path(STREAM_CACHE_DIR + cur.first).write_file(cur.second.data(), cur.second.size());
+		if (result.code != 0) {
+			logger.error("stream-cache", "write failed : " + result.string + result.error_description);
+			Path(STREAM_CACHE_DIR + cur.first).delete_file();
+			continue;
+		}
+
+		std::vector<std::string> evicted;
+		cache_lock.lock();
+		remove_entry(cur.first);
+		lru_list.push_back({cur.first, cur.second.size()});
+		entries[cur.first] = std::prev(lru_list.end());
+		stats.total_size += cur.second.size();
+		stats.written_num++;
+		index_dirty = true;
+		u64 size_limit = (u64)std::max(var_stream_cache_size_mb, 0) * 1000000;
+		while (stats.total_size > size_limit && lru_list.size()) {
+			evicted.push_back(lru_list.front().first);
+			remove_entry(evicted.back());
+		}
+		cache_lock.unlock();
+
+		for (auto &name : evicted) {
+			Path(STREAM_CACHE_DIR + name).delete_file();
+		}
+	}
+
+	cache_lock.lock();
+	bool need_save = index_dirty;
+	pending_writes.clear();
+	cache_lock.unlock();
+	if (need_save) {
+		save_index();
+	}
+
+	logger.info("stream-cache", "Thread exit.");
+	threadExit(0);
+}
+void stream_cache_thread_exit_request() {
+	should_be_running = false;
+	write_event.signal();
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <vector>
+#include <string>
+#include "types.hpp"
+
+// blocks of recently watched streams kept on the SD card, so that rewatching or seeking back does not download them
+// again
+// the total size is bounded by var_stream_cache_size_mb, and the least recently used blocks are deleted first
+
+struct StreamCacheStats {
+	u64 hit_num = 0;
+	u64 miss_num = 0;
+	u64 written_num = 0;
+	u64 dropped_num = 0; // blocks not written because the writer could not keep up
+	u64 total_size = 0;  // bytes currently stored
+};
+
+// the key identifying the content of a stream, "" if it should not be cached
+// the stream url itself expires, so the video id, the itag and the content length are used instead
+std::string stream_cache_make_key(const std::string &video_id, const std::string &url, u64 len);
+
+// reads the block `block` of the stream `key` into `buf`, returns true only if the whole `size` bytes were read
+bool stream_cache_read(const std::string &key, u64 block, u8 *buf, size_t size);
+// queues the block to be written by the cache thread, it is dropped if too many blocks are waiting to be written
+void stream_cache_write(const std::string &key, u64 block, std::vector<u8> &&data);
+
+StreamCacheStats stream_cache_get_stats();
+
+void stream_cache_thread_func(void *arg);
+void stream_cache_thread_exit_request(void);
@@ -0,0 +1,128 @@
+#include "headers.hpp"
+#include "thumbnail_atlas.hpp"
+
+namespace {
+struct AtlasLayout {
+	ThumbnailType type;
+	GPU_TEXCOLOR format;
+	int slot_width; // multiples of 8 so that every slot starts on a tile
+	int slot_height;
+	int page_width;
+	int page_height;
+	int page_max;
+};
+struct AtlasPage {
+	Image_data image; // image.c2d.tex is shared by all the slots, NULL if the page is not allocated
+	std::vector<bool> used;
+	std::vector<Tex3DS_SubTexture> subtex;
+	int used_num = 0;
+};
+} // namespace
+
+#define ATLAS_PAGE_MAX 4
+static const AtlasLayout layouts[] = {
+    // default.jpg (120x90) cropped to 120x67 : 56 slots in 1 MB (18 KB each), instead of a 128x128 texture (32 KB)
+    {ThumbnailType::VIDEO_THUMBNAIL, GPU_RGB565, 120, 72, 1024, 512, 4},
+    // icons up to 88x88 : 25 slots in 1 MB (42 KB each), instead of a 128x128 texture (64 KB)
+    {ThumbnailType::ICON, GPU_RGBA8, 88, 88, 512, 512, 2},
+};
+#define ATLAS_NUM ((int)(sizeof(layouts) / sizeof(layouts[0])))
+
+static Mutex atlas_lock;
+static AtlasPage pages[ATLAS_NUM][ATLAS_PAGE_MAX];
+
+// must be called with `atlas_lock` held
+static bool allocate_page(int atlas, int page) {
+	const AtlasLayout &layout = layouts[atlas];
+	AtlasPage &cur = pages[atlas][page];
+
+	Result_with_string result = Draw_c2d_image_init(&cur.image, layout.page_width, layout.page_height, layout.format);
+	if (result.code != 0) {
+		logger.warning("thumb-atlas", "out of linearmem, thumbnails get their own textures");
+		linearFree_concurrent(cur.image.c2d.tex);
+		linearFree_concurrent(cur.image.subtex);
+		cur.image = Image_data();
+		return false;
+	}
+	int slot_num = (layout.page_width / layout.slot_width) * (layout.page_height / layout.slot_height);
+	cur.used.assign(slot_num, false);
+	cur.subtex.assign(slot_num, Tex3DS_SubTexture());
+	cur.used_num = 0;
+	return true;
+}
+
+bool thumbnail_atlas_load(ThumbnailType type, u8 *data, int width, int height, Image_data *image,
+                          ThumbnailAtlasSlot *slot) {
+	int atlas = -1;
+	for (int i = 0; i < ATLAS_NUM; i++) {
+		if (layouts[i].type == type) {
+			atlas = i;
+		}
+	}
+	if (atlas == -1 || width > layouts[atlas].slot_width || height > layouts[atlas].slot_height) {
+		return false;
+	}
+	const AtlasLayout &layout = layouts[atlas];
+
+	atlas_lock.lock();
+	// fill the pages in order so that the last ones are the most likely to become empty and be freed
+	int page = -1;
+	for (int i = 0; i < layout.page_max && page == -1; i++) {
+		if (pages[atlas][i].image.c2d.tex && pages[atlas][i].used_num < (int)pages[atlas][i].used.size()) {
+			page = i;
+		}
+	}
+	for (int i = 0; i < layout.page_max && page == -1; i++) {
+		if (!pages[atlas][i].image.c2d.tex) {
+			if (!allocate_page(atlas, i)) {
+				break;
+			}
+			page = i;
+		}
+	}
+	if (page == -1) {
+		atlas_lock.unlock();
+		return false;
+	}
+	AtlasPage &cur = pages[atlas][page];
+	int index = std::find(cur.used.begin(), cur.used.end(), false) - cur.used.begin();
+	cur.used[index] = true;
+	cur.used_num++;
+	atlas_lock.unlock();
+
+	// the page stays allocated while the slot is in use, so it can be written without the lock
+	int columns = layout.page_width / layout.slot_width;
+	*image = cur.image;
+	image->subtex = &cur.subtex[index];
+	image->c2d.subtex = image->subtex;
+	*slot = {atlas, page, index};
+	Result_with_string result =
+	    Draw_set_texture_sub_data(image, data, width, height, index % columns * layout.slot_width,
+	                              index / columns * layout.slot_height, layout.format);
+	if (result.code != 0) {
+		logger.error("thumb-atlas", "Draw_set_texture_sub_data() failed");
+		thumbnail_atlas_free(*slot);
+		*slot = ThumbnailAtlasSlot();
+		return false;
+	}
+	return true;
+}
+
+void thumbnail_atlas_free(const ThumbnailAtlasSlot &slot) {
+	if (slot.atlas == -1) {
+		return;
+	}
+	atlas_lock.lock();
+	AtlasPage &cur = pages[slot.atlas][slot.page];
+	if (cur.used[slot.index]) {
+		cur.used[slot.index] = false;
+		cur.used_num--;
+	}
+	if (!cur.used_num) {
+		Draw_c2d_image_free(cur.image);
+		cur.image = Image_data();
+		cur.used.clear();
+		cur.subtex.clear();
+	}
+	atlas_lock.unlock();
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include "types.hpp"
+#include "thumbnail_loader.hpp"
+
+// thumbnails of the same type share a few large textures ("pages") split into fixed-size slots, instead of getting
+// a texture rounded up to a power of two each
+// only the types shown in long lists are packed, and a thumbnail larger than the slot of its type, or loaded while all
+// the pages are full, gets its own texture as before
+
+struct ThumbnailAtlasSlot {
+	int atlas = -1; // -1 if the thumbnail is not in the atlas
+	int page = -1;
+	int index = -1;
+};
+
+// allocates a slot and uploads the image (in the same format as a texture of its own would have) to it
+// on success, `image` refers to the slot and must be released with thumbnail_atlas_free(), not Draw_c2d_image_free()
+bool thumbnail_atlas_load(ThumbnailType type, u8 *data, int width, int height, Image_data *image,
+                          ThumbnailAtlasSlot *slot);
+// the page is freed as well once all its slots are free
+void thumbnail_atlas_free(const ThumbnailAtlasSlot &slot);
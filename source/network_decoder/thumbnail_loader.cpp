@@ -1,6 +1,7 @@
 #include "headers.hpp"
 #include "network_io.hpp"
 #include "thumbnail_loader.hpp"
+#include "thumbnail_atlas.hpp"
 #include <set>
 #include <map>
 #include <queue>
@@ -20,8 +21,17 @@ struct LoadedThumbnail {
 	int texture_width;
 	int texture_height;
 	Image_data data;
+	ThumbnailAtlasSlot atlas_slot; // data refers to a slot of the atlas instead of a texture of its own
 };
 
+static void free_loaded_thumbnail(const LoadedThumbnail &thumbnail) {
+	if (thumbnail.atlas_slot.atlas != -1) {
+		thumbnail_atlas_free(thumbnail.atlas_slot);
+	} else {
+		Draw_c2d_image_free(thumbnail.data);
+	}
+}
+
 struct Request {
 	std::string url;
 	SceneType scene;
@@ -84,7 +94,7 @@ inline static void thumbnail_cancel_request_wo_lock(int handle) {
 	url_status.handles.erase(handle);
 	if (!url_status.handles.size()) {
 		if (url_status.is_loaded) {
-			Draw_c2d_image_free(url_status.data.data);
+			free_loaded_thumbnail(url_status.data);
 		}
 		requested_urls.erase(url);
 		thumbnail_free_time[url] = ++thumbnail_free_time_cnter;
@@ -260,8 +270,203 @@ static std::vector<u8> http_get(const std::string &url, int &status_code) {
 	return result.data;
 }
 
+// decodes the downloaded (or cached) data and uploads it as a texture
+static void load_downloaded_thumbnail(NetworkResult &res, const std::string &url, ThumbnailType type) {
+	int w, h;
+	u8 *decoded_data = NULL;
+	if (res.data.size()) {
+		// icons are decoded in RGBA8 to have the alpha mask applied
+		if (type == ThumbnailType::ICON) {
+			decoded_data = Image_decode_rgba8(&res.data[0], res.data.size(), &w, &h);
+		} else {
+			decoded_data = Image_decode(&res.data[0], res.data.size(), &w, &h);
+		}
+	}
+	if (decoded_data) {
+		// update cache
+		resource_lock.lock();
+		if (thumbnail_cache.size() >= THUMBNAIL_CACHE_MAX) {
+			std::string erase_url;
+			int min_time = std::numeric_limits<int>::max();
+			for (auto &item : thumbnail_cache) {
+				if (!thumbnail_free_time.count(item.first)) {
+					continue;
+				}
+				int cur_time = thumbnail_free_time[item.first];
+				if (min_time > cur_time) {
+					min_time = cur_time;
+					erase_url = item.first;
+				}
+			}
+			if (erase_url != "") {
+				thumbnail_cache.erase(erase_url);
+			}
+		}
+		thumbnail_cache[url] = res.data;
+		if (thumbnail_cache.size() >= THUMBNAIL_CACHE_MAX + 10) {
+			logger.warning("tloader", "over caching : " + std::to_string(thumbnail_cache.size()));
+		}
+		resource_lock.unlock();
+
+		// some special operations on the picture here (it shouldn't be here but...)
+		// for video thumbnail, crop to 16:9
+		if (type == ThumbnailType::VIDEO_THUMBNAIL && h > w * 9 / 16 + 1) {
+			int new_h = w * 9 / 16;
+			int vertical_offset = (h - new_h) / 2;
+			memmove(decoded_data, decoded_data + vertical_offset * w * 2, new_h * w * 2);
+			h = new_h;
+		}
+		// channel icon : round
+		// with alpha mask (decoded in RGBA8 with opaque alpha)
+		if (type == ThumbnailType::ICON) {
+			u32 *rgba_data = (u32 *)decoded_data;
+			float cx = (float)w / 2.0f;
+			float cy = (float)h / 2.0f;
+			float radius = std::min(cx, cy);
+			for (int i = 0; i < h; i++) {
+				for (int j = 0; j < w; j++) {
+					float distance = std::hypot(cy - (i + 0.5f), cx - (j + 0.5f));
+					float proportion = std::max(0.0f, std::min(1.0f, radius + 0.5f - distance));
+					u8 a = (u8)(proportion * 255);
+
+					rgba_data[i * w + j] = (rgba_data[i * w + j] & 0xFFFFFF00) | (u32)a;
+				}
+			}
+		}
+
+		Image_data result_image;
+		int texture_w = 1;
+		while (texture_w < w) {
+			texture_w <<= 1;
+		}
+		int texture_h = 1;
+		while (texture_h < h) {
+			texture_h <<= 1;
+		}
+
+		Result_with_string result;
+		GPU_TEXCOLOR format = (type == ThumbnailType::ICON) ? GPU_RGBA8 : GPU_RGB565;
+		ThumbnailAtlasSlot atlas_slot;
+
+		if (!thumbnail_atlas_load(type, decoded_data, w, h, &result_image, &atlas_slot)) {
+			result = Draw_c2d_image_init(&result_image, texture_w, texture_h, format);
+			if (result.code != 0) {
+				logger.error("thumb-dl", "out of linearmem");
+			} else {
+				result = Draw_set_texture_data(&result_image, decoded_data, w, h, texture_w, texture_h, format);
+				if (result.code != 0) {
+					logger.error("thumb-dl", "Draw_set_texture_data() failed");
+					Draw_c2d_image_free(result_image);
+				}
+			}
+		}
+		if (result.code == 0) {
+			LoadedThumbnail loaded = {w, h, texture_w, texture_h, result_image, atlas_slot};
+			resource_lock.lock();
+			bool requested = requested_urls.count(url); // in case the request is cancelled while downloading
+			if (requested) {
+				requested_urls[url].is_loaded = true;
+				requested_urls[url].data = loaded;
+			}
+			resource_lock.unlock();
+			if (!requested) {
+				free_loaded_thumbnail(loaded);
+			}
+		}
+		free(decoded_data);
+		decoded_data = NULL;
+	} else {
+		resource_lock.lock();
+		if (requested_urls.count(url)) {
+			requested_urls[url].is_loaded = false;
+			requested_urls[url].error = true;
+			if (res.status_code / 100 != 4 && res.status_code / 100 != 2) {
+				requested_urls[url].waiting_retry = true;
+				requested_urls[url].next_retry = time(NULL) + 3;
+			} else {
+				requested_urls[url].waiting_retry = false;
+			}
+			requested_urls[url].last_status_code = res.status_code;
+		}
+		resource_lock.unlock();
+		std::string err_msg = "load failed (http code : " + std::to_string(res.status_code) +
+		                      ") size:" + std::to_string(res.data.size()) + " err:" + res.error;
+
+		logger.error("thumb-dl", err_msg);
+	}
+}
+
+#define THUMBNAIL_IN_FLIGHT_MAX 8 // the number of thumbnail downloads kept running at the same time
+// neither a cached thumbnail is queued nor a download is submitted while this many thumbnails are waiting to be
+// decoded, so the queue holds at most THUMBNAIL_DECODE_QUEUE_MAX + THUMBNAIL_IN_FLIGHT_MAX thumbnails
+#define THUMBNAIL_DECODE_QUEUE_MAX 8
+#define THUMBNAIL_STATS_SMOOTHING 0.2
+
+// must be called with `resource_lock` held
+static int get_priority(const URLStatus &status) {
+	int priority = 0;
+	for (auto handle : status.handles) {
+		priority = std::max(priority, requests[handle].priority +
+		                                  (requests[handle].scene == active_scene ? PRIORITY_ACTIVE_SCENE : 0));
+	}
+	return priority;
+}
+
+// the downloader thread only downloads, and the decoder thread decodes and uploads what has been downloaded
+struct DecodeJob {
+	std::string url;
+	ThumbnailType type;
+	NetworkResult result;
+	TickCounter stage_time; // started when the current stage began
+};
+static std::vector<DecodeJob> decode_queue; // guarded by `resource_lock`
+static std::set<std::string> decoding_urls; // queued or being decoded, guarded by `resource_lock`
+static Event decode_event;                  // signaled when a job is queued or the exit is requested
+static ThumbnailLoaderStats stats;          // guarded by `resource_lock`
+
+static void update_average(double *average, double value) {
+	*average = *average ? *average * (1 - THUMBNAIL_STATS_SMOOTHING) + value * THUMBNAIL_STATS_SMOOTHING : value;
+}
+
+// `download_time` : started when the download was submitted, NULL if the data comes from the cache
+static void queue_decode(const std::string &url, ThumbnailType type, NetworkResult &&result,
+                         TickCounter *download_time) {
+	DecodeJob job;
+	job.url = url;
+	job.type = type;
+	job.result = std::move(result);
+	osTickCounterStart(&job.stage_time);
+
+	resource_lock.lock();
+	if (download_time) {
+		osTickCounterUpdate(download_time);
+		update_average(&stats.download_ms, osTickCounterRead(download_time));
+	}
+	decode_queue.push_back(std::move(job));
+	decoding_urls.insert(url);
+	resource_lock.unlock();
+	decode_event.signal();
+}
+
+ThumbnailLoaderStats thumbnail_get_stats() {
+	resource_lock.lock();
+	ThumbnailLoaderStats res = stats;
+	res.queued_num = decode_queue.size();
+	resource_lock.unlock();
+	return res;
+}
+
 static bool should_be_running = true;
 void thumbnail_downloader_thread_func(void *arg) {
+	struct InFlight {
+		std::string url;
+		ThumbnailType type;
+		TickCounter issued_time;
+	};
+	std::map<int, InFlight> in_flight; // id returned by NetworkSessionList::submit() -> the thumbnail being downloaded
+	std::set<std::string> in_flight_urls;
+
+	confirm_thread_network_session_list_inited();
 	while (should_be_running) {
 		resource_lock.lock();
 		struct Item {
@@ -272,220 +477,174 @@ void thumbnail_downloader_thread_func(void *arg) {
 		std::vector<Item> download_list;
 		{
 			for (auto &i : requested_urls) {
-				if (i.second.is_loaded) {
+				if (i.second.is_loaded || in_flight_urls.count(i.first) || decoding_urls.count(i.first)) {
 					continue;
 				}
 				if (i.second.error && (!i.second.waiting_retry || time(NULL) < i.second.next_retry)) {
 					continue;
 				}
-				int priority = 0;
-				for (auto handle : i.second.handles) {
-					priority =
-					    std::max(priority, requests[handle].priority +
-					                           (requests[handle].scene == active_scene ? PRIORITY_ACTIVE_SCENE : 0));
-				}
-				download_list.push_back({priority, i.first, i.second.type});
+				download_list.push_back({get_priority(i.second), i.first, i.second.type});
 			}
 		}
-		resource_lock.unlock();
-
-		if (!download_list.size()) {
-			usleep(50000);
-			continue;
+		// abort the downloads of thumbnails that are no longer requested (e.g. the scene was left while loading)
+		std::vector<int> cancelled_ids;
+		std::vector<int> background_ids; // downloads for thumbnails not shown in the active scene
+		for (auto &i : in_flight) {
+			if (!requested_urls.count(i.second.url)) {
+				cancelled_ids.push_back(i.first);
+			} else if (get_priority(requested_urls[i.second.url]) < PRIORITY_ACTIVE_SCENE) {
+				background_ids.push_back(i.first);
+			}
 		}
+		size_t decode_queue_num = decode_queue.size(); // only grows here, the decoder thread takes jobs concurrently
+		resource_lock.unlock();
 
 		// sort in the decreasing order of the priority
 		std::sort(download_list.begin(), download_list.end(),
 		          [](const auto &i, const auto &j) { return i.priority > j.priority; });
 
-		std::string priority_str;
-		for (auto i : download_list) {
-			priority_str += std::to_string(i.priority) + " ";
+		// the thumbnails of the active scene take over the slots of the background downloads if there are not enough
+		// (the aborted ones are downloaded again later as they are still requested)
+		int waiting_active_num = 0;
+		while (waiting_active_num < (int)download_list.size() &&
+		       download_list[waiting_active_num].priority >= PRIORITY_ACTIVE_SCENE) {
+			waiting_active_num++;
 		}
-		if (download_list[0].priority >=
-		    PRIORITY_ACTIVE_SCENE + PRIORITY_FOREGROUND) { // load thumbnails in the foreground first
+		int free_slot_num = THUMBNAIL_IN_FLIGHT_MAX - (in_flight.size() - cancelled_ids.size());
+		for (size_t i = 0; i < background_ids.size() && free_slot_num < waiting_active_num; i++) {
+			cancelled_ids.push_back(background_ids[i]);
+			free_slot_num++;
+		}
+		for (auto id : cancelled_ids) {
+			thread_network_session_list.cancel(id);
+			in_flight_urls.erase(in_flight[id].url);
+			in_flight.erase(id);
+		}
+
+		// load thumbnails in the foreground first
+		if (download_list.size() && download_list[0].priority >= PRIORITY_ACTIVE_SCENE + PRIORITY_FOREGROUND) {
 			while (download_list.back().priority < PRIORITY_ACTIVE_SCENE + PRIORITY_FOREGROUND) {
 				download_list.pop_back();
 			}
 		}
 
-		std::vector<NetworkResult> results(download_list.size());
-		std::vector<int> uncached_index_list;
-		std::vector<int> cached_index_list;
-		for (size_t i = 0; i < download_list.size(); i++) {
-			if (thumbnail_cache.count(download_list[i].url)) {
-				results[i].status_code = 0; // cached
-				results[i].data = thumbnail_cache[download_list[i].url];
-				cached_index_list.push_back(i);
-			} else {
-				uncached_index_list.push_back(i);
+		// cached thumbnails are queued for decoding right away, the others are submitted as long as there is a free slot
+		bool queued_cached = false;
+		for (auto &item : download_list) {
+			if (decode_queue_num >= THUMBNAIL_DECODE_QUEUE_MAX) {
+				break; // the rest is picked up once the decoder has caught up
 			}
-		}
+			NetworkResult cached_result;
+			resource_lock.lock();
+			bool cached = thumbnail_cache.count(item.url);
+			if (cached) {
+				cached_result.status_code = 0;
+				cached_result.data = thumbnail_cache[item.url];
+			}
+			resource_lock.unlock();
 
-		auto load_downloaded_thumbnail = [&](int i) {
-			auto &res = results[i];
-			auto &info = download_list[i];
+			if (cached) {
+				queue_decode(item.url, item.type, std::move(cached_result), NULL);
+				decode_queue_num++;
+				queued_cached = true;
+			} else if (in_flight.size() < THUMBNAIL_IN_FLIGHT_MAX) {
+				int id = thread_network_session_list.submit(HttpRequest::GET(item.url, {}));
+				in_flight[id] = {item.url, item.type, TickCounter()};
+				osTickCounterStart(&in_flight[id].issued_time);
+				in_flight_urls.insert(item.url);
+			}
+		}
 
-			int w, h;
-			u8 *decoded_data = NULL;
-			if (res.data.size()) {
-				decoded_data = Image_decode(&res.data[0], res.data.size(), &w, &h);
+		if (!in_flight.size()) {
+			if (!queued_cached) {
+				usleep(50000);
 			}
-			if (decoded_data) {
-				// update cache
-				resource_lock.lock();
-				if (thumbnail_cache.size() >= THUMBNAIL_CACHE_MAX) {
-					std::string erase_url;
-					int min_time = std::numeric_limits<int>::max();
-					for (auto &item : thumbnail_cache) {
-						if (!thumbnail_free_time.count(item.first)) {
-							continue;
-						}
-						int cur_time = thumbnail_free_time[item.first];
-						if (min_time > cur_time) {
-							min_time = cur_time;
-							erase_url = item.first;
-						}
-					}
-					if (erase_url != "") {
-						thumbnail_cache.erase(erase_url);
-					}
-				}
-				thumbnail_cache[info.url] = res.data;
-				if (thumbnail_cache.size() >= THUMBNAIL_CACHE_MAX + 10) {
-					logger.warning("tloader", "over caching : " + std::to_string(thumbnail_cache.size()));
-				}
-				resource_lock.unlock();
-
-				// some special operations on the picture here (it shouldn't be here but...)
-				// for video thumbnail, crop to 16:9
-				if (info.type == ThumbnailType::VIDEO_THUMBNAIL && h > w * 9 / 16 + 1) {
-					int new_h = w * 9 / 16;
-					int vertical_offset = (h - new_h) / 2;
-					memmove(decoded_data, decoded_data + vertical_offset * w * 2, new_h * w * 2);
-					h = new_h;
-				}
-				// channel icon : round
-				// with alpha mask
-				if (info.type == ThumbnailType::ICON) {
-					u32 *rgba_data = (u32 *)malloc(w * h * 4);
-					if (rgba_data) {
-						float cx = (float)w / 2.0f;
-						float cy = (float)h / 2.0f;
-						float radius = std::min(cx, cy);
-						for (int i = 0; i < h; i++) {
-							for (int j = 0; j < w; j++) {
-								float distance = std::hypot(cy - (i + 0.5f), cx - (j + 0.5f));
-								u8 b = decoded_data[(i * w + j) * 2 + 0] & ((1 << 5) - 1);
-								u8 g = (decoded_data[(i * w + j) * 2 + 0] >> 5) |
-								       ((decoded_data[(i * w + j) * 2 + 1] & ((1 << 3) - 1)) << 3);
-								u8 r = decoded_data[(i * w + j) * 2 + 1] >> 3;
-
-								// 565 to 888
-								b = (b << 3) | (b >> 2);
-								g = (g << 2) | (g >> 4);
-								r = (r << 3) | (r >> 2);
-
-								float proportion = std::max(0.0f, std::min(1.0f, radius + 0.5f - distance));
-								u8 a = (u8)(proportion * 255);
-
-								rgba_data[i * w + j] = ((u32)r << 24) | ((u32)g << 16) | ((u32)b << 8) | (u32)a;
-							}
-						}
-						free(decoded_data);
-						decoded_data = (u8 *)rgba_data;
-					}
-				}
+			continue;
+		}
+		// wait for at least one download to finish (or for new requests to come), then pick up everything finished
+		int id;
+		NetworkResult result;
+		int timeout_ms = 50;
+		while (thread_network_session_list.wait_any(&id, &result, timeout_ms)) {
+			timeout_ms = 0;
+			if (!in_flight.count(id)) {
+				continue;
+			}
+			InFlight finished = in_flight[id];
+			in_flight.erase(id);
+			in_flight_urls.erase(finished.url);
+			queue_decode(finished.url, finished.type, std::move(result), &finished.issued_time);
+		}
+	}
 
-				Image_data result_image;
-				int texture_w = 1;
-				while (texture_w < w) {
-					texture_w <<= 1;
-				}
-				int texture_h = 1;
-				while (texture_h < h) {
-					texture_h <<= 1;
-				}
+	for (auto &i : in_flight) {
+		thread_network_session_list.cancel(i.first);
+	}
+	in_flight.clear();
 
-				Result_with_string result;
-				GPU_TEXCOLOR format = (info.type == ThumbnailType::ICON) ? GPU_RGBA8 : GPU_RGB565;
+	logger.info("thumb-dl", "Thread exit.");
+	threadExit(0);
+}
+void thumbnail_downloader_thread_exit_request() { should_be_running = false; }
 
-				result = Draw_c2d_image_init(&result_image, texture_w, texture_h, format);
-				if (result.code != 0) {
-					logger.error("thumb-dl", "out of linearmem");
-				} else {
-					result = Draw_set_texture_data(&result_image, decoded_data, w, h, texture_w, texture_h, format);
-					if (result.code != 0) {
-						logger.error("thumb-dl", "Draw_set_texture_data() failed");
-					} else {
-						resource_lock.lock();
-						if (requested_urls.count(info.url)) { // in case the request is cancelled while downloading
-							requested_urls[info.url].is_loaded = true;
-							requested_urls[info.url].data = {w, h, texture_w, texture_h, result_image};
-						}
-						resource_lock.unlock();
-					}
-				}
-				free(decoded_data);
-				decoded_data = NULL;
-			} else {
-				resource_lock.lock();
-				if (requested_urls.count(info.url)) {
-					requested_urls[info.url].is_loaded = false;
-					requested_urls[info.url].error = true;
-					if (res.status_code / 100 != 4 && res.status_code / 100 != 2) {
-						requested_urls[info.url].waiting_retry = true;
-						requested_urls[info.url].next_retry = time(NULL) + 3;
-					} else {
-						requested_urls[info.url].waiting_retry = false;
-					}
-					requested_urls[info.url].last_status_code = res.status_code;
-				}
-				resource_lock.unlock();
-				std::string err_msg = "load failed (http code : " + std::to_string(res.status_code) +
-				                      ") size:" + std::to_string(res.data.size()) + " err:" + res.error;
+static bool decoder_should_be_running = true;
+void thumbnail_decoder_thread_func(void *arg) {
+	(void)arg;
 
-				logger.error("thumb-dl", err_msg);
+	while (decoder_should_be_running) {
+		resource_lock.lock();
+		// the one with the highest priority at this moment first, the ones no longer requested are dropped
+		int best = -1;
+		int best_priority = 0;
+		for (int i = 0; i < (int)decode_queue.size();) {
+			if (!requested_urls.count(decode_queue[i].url)) {
+				decoding_urls.erase(decode_queue[i].url);
+				decode_queue.erase(decode_queue.begin() + i);
+				continue;
 			}
-		};
-		TickCounter counter;
-		osTickCounterStart(&counter);
-		// Util_log_save("thumb-dl", "load cached : " + std::to_string(cached_index_list.size()));
-		osTickCounterUpdate(&counter);
-		for (auto i : cached_index_list) {
-			load_downloaded_thumbnail(i);
-		}
-		osTickCounterUpdate(&counter);
-		// Util_log_save("thumb-dl", std::to_string((int) osTickCounterRead(&counter)) + " ms");
-
-		// Util_log_save("thumb-dl", "start dl : " + std::to_string(uncached_index_list.size()));
-		// load uncached thumbnails
-		{
-			confirm_thread_network_session_list_inited();
-			std::vector<HttpRequest> requests;
-			for (auto i : uncached_index_list) {
-				requests.push_back(HttpRequest::GET(download_list[i].url, {})
-				                       .with_on_finish_callback([&](NetworkResult &res, int index) {
-					                       results[uncached_index_list[index]] = res;
-					                       load_downloaded_thumbnail(uncached_index_list[index]);
-				                       }));
+			int priority = get_priority(requested_urls[decode_queue[i].url]);
+			if (best == -1 || priority > best_priority) {
+				best = i;
+				best_priority = priority;
 			}
-			thread_network_session_list.perform(requests);
+			i++;
 		}
-		osTickCounterUpdate(&counter);
-		// Util_log_save("thumb-dl", std::to_string((int) osTickCounterRead(&counter)) + " ms");
+		if (best == -1) {
+			resource_lock.unlock();
+			decode_event.wait();
+			continue;
+		}
+		DecodeJob job = std::move(decode_queue[best]);
+		decode_queue.erase(decode_queue.begin() + best);
+		osTickCounterUpdate(&job.stage_time);
+		update_average(&stats.queue_ms, osTickCounterRead(&job.stage_time));
+		resource_lock.unlock();
+
+		load_downloaded_thumbnail(job.result, job.url, job.type);
+
+		osTickCounterUpdate(&job.stage_time);
+		resource_lock.lock();
+		update_average(&stats.decode_ms, osTickCounterRead(&job.stage_time));
+		stats.decoded_num++;
+		decoding_urls.erase(job.url);
+		resource_lock.unlock();
 	}
 
 	resource_lock.lock();
+	decode_queue.clear();
+	decoding_urls.clear();
 	for (auto i : requested_urls) {
 		if (i.second.is_loaded) {
-			Draw_c2d_image_free(i.second.data.data);
+			free_loaded_thumbnail(i.second.data);
 		}
 	}
 	requested_urls.clear();
 	resource_lock.unlock();
 
-	logger.info("thumb-dl", "Thread exit.");
+	logger.info("thumb-decode", "Thread exit.");
 	threadExit(0);
 }
-void thumbnail_downloader_thread_exit_request() { should_be_running = false; }
+void thumbnail_decoder_thread_exit_request() {
+	decoder_should_be_running = false;
+	decode_event.signal();
+}
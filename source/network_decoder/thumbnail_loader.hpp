@@ -30,5 +30,19 @@ void thumbnail_get_dimensions(int handle, int *width, int *height);
 
 bool thumbnail_draw(int handle, int x_offset, int y_offset, int x_len, int y_len);
 
+// latency of each stage, exponential moving averages in milliseconds
+struct ThumbnailLoaderStats {
+	double download_ms = 0; // from the submission to the end of the download (thumbnails in the memory cache excluded)
+	double queue_ms = 0;    // waiting for the decoder thread
+	double decode_ms = 0;   // decoding and uploading to the texture
+	u64 decoded_num = 0;
+	int queued_num = 0; // waiting to be decoded right now
+};
+ThumbnailLoaderStats thumbnail_get_stats();
+
+// downloads the thumbnails and passes them to the decoder thread
 void thumbnail_downloader_thread_func(void *arg);
 void thumbnail_downloader_thread_exit_request(void);
+// decodes the downloaded thumbnails, the most wanted one first, and uploads them to the textures
+void thumbnail_decoder_thread_func(void *arg);
+void thumbnail_decoder_thread_exit_request(void);
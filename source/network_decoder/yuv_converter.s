@@ -3,11 +3,9 @@
 .data
 .align 4
 .global memcpy_asm
-.global memcpy_asm_4b
 .global yuv420p_to_bgr565_asm
 .global yuv420p_to_bgr888_asm
 .type memcpy_asm, %function
-.type memcpy_asm_4b, %function
 .type yuv420p_to_bgr565_asm, %function
 .type yuv420p_to_bgr888_asm, %function
 
@@ -71,11 +69,6 @@ copy_finished:
 	pop {r4-r11}
 	bx lr
 
-memcpy_asm_4b:
-	ldr r2, [r1]
-	str r2, [r0]
-	bx lr
-
 // r0 = Y plane, r1 = output, r2 = width, r3 = height
 yuv420p_to_bgr565_asm:
 	push {r4-r11, lr}
@@ -0,0 +1,122 @@
+#include <string.h>
+#include "yuv_tiled.h"
+
+// R = (75 * (Y - 16) + 115 * (V - 128)) / 64
+// G = (75 * (Y - 16) - 14 * (U - 128) - 34 * (V - 128)) / 64
+// B = (75 * (Y - 16) + 135 * (U - 128)) / 64
+#define COEF_R_V 115
+#define COEF_G_U 14
+#define COEF_G_V 34
+#define COEF_B_U 135
+// 75 * (Y - 16) + 32 (for rounding) == 75 * Y - Y_OFFSET
+#define Y_OFFSET (75 * 16 - 32)
+
+static void clip_size(int *width, int *height, int tex_width, int tex_height) {
+	*width = (*width + 7) / 8 * 8;
+	*height = (*height + 7) / 8 * 8;
+	if (*width > tex_width) {
+		*width = tex_width;
+	}
+	if (*height > tex_height) {
+		*height = tex_height;
+	}
+}
+
+static int clip(int x, int max) { return x < 0 ? 0 : x > max ? max : x; }
+
+void yuv420p_to_bgr565_tiled_ref(const uint8_t *y, const uint8_t *u, const uint8_t *v, int y_line_size,
+                                 int uv_line_size, uint16_t *texture, int width, int height, int tex_width,
+                                 int tex_height) {
+	clip_size(&width, &height, tex_width, tex_height);
+
+	for (int j = 0; j < height; j++) {
+		for (int i = 0; i < width; i++) {
+			int c = 75 * y[j * y_line_size + i] - Y_OFFSET;
+			int d = u[j / 2 * uv_line_size + i / 2] - 128;
+			int e = v[j / 2 * uv_line_size + i / 2] - 128;
+			// 8-bit value >> 3 (or >> 2 for green), the same as the SIMD version
+			int r = clip((c + COEF_R_V * e) >> 9, 31);
+			int g = clip((c - COEF_G_U * d - COEF_G_V * e) >> 8, 63);
+			int b = clip((c + COEF_B_U * d) >> 9, 31);
+
+			int tile = j / 8 * (tex_width / 8) + i / 8;
+			int morton = (i & 1) | (j & 1) << 1 | (i & 2) << 1 | (j & 2) << 2 | (i & 4) << 2 | (j & 4) << 3;
+			texture[tile * 64 + morton] = r << 11 | g << 5 | b;
+		}
+	}
+}
+
+#ifdef __ARM_FEATURE_SIMD32
+#include <arm_acle.h>
+
+// two signed 16-bit values in one word
+static inline uint32_t pack16(int low, int high) { return (uint16_t)low | (uint32_t)high << 16; }
+
+// 75 * Y - Y_OFFSET for the two Y in the 16-bit lanes (75 == 64 + 8 + 2 + 1, no lane can overflow into the next)
+static inline int16x2_t luma_term(uint32_t y) {
+	uint32_t res = y + (y << 1) + (y << 3) + (y << 6);
+	return __ssub16(res, pack16(Y_OFFSET, Y_OFFSET));
+}
+
+static inline uint32_t to_bgr565(int16x2_t c, int16x2_t r_term, int16x2_t g_term, int16x2_t b_term) {
+	// the saturation of qadd16 only affects values that would be clipped to 255 anyway
+	uint32_t r = __usat16(__qadd16(c, r_term), 15);
+	uint32_t g = __usat16(__qadd16(c, g_term), 15);
+	uint32_t b = __usat16(__qadd16(c, b_term), 15);
+	// every lane is non-negative now, so the whole word can be shifted as long as the bits from the high lane are
+	// masked out
+	r = __usat16((r >> 9) & 0x007F007F, 5);
+	g = __usat16((g >> 8) & 0x00FF00FF, 6);
+	b = __usat16((b >> 9) & 0x007F007F, 5);
+	return r << 11 | g << 5 | b;
+}
+
+// converts 4x2 pixels, that is 2 blocks of 2x2 pixels sharing one chroma sample each
+// a 2x2 block takes 4 consecutive pixels in the Morton order, so `dst` receives the 2 blocks in 16 bytes
+static inline void convert_4x2(const uint8_t *y0, const uint8_t *y1, const uint8_t *u, const uint8_t *v,
+                               uint32_t *dst) {
+	int d0 = u[0] - 128, d1 = u[1] - 128;
+	int e0 = v[0] - 128, e1 = v[1] - 128;
+	int16x2_t r_term = pack16(COEF_R_V * e0, COEF_R_V * e1);
+	int16x2_t g_term = pack16(-COEF_G_U * d0 - COEF_G_V * e0, -COEF_G_U * d1 - COEF_G_V * e1);
+	int16x2_t b_term = pack16(COEF_B_U * d0, COEF_B_U * d1);
+
+	const uint8_t *rows[2] = {y0, y1};
+	for (int i = 0; i < 2; i++) {
+		uint32_t y4;
+		memcpy(&y4, rows[i], 4);
+		// {x0, x2} and {x1, x3}
+		uint32_t even = to_bgr565(luma_term(__uxtb16(y4)), r_term, g_term, b_term);
+		uint32_t odd = to_bgr565(luma_term(__uxtb16(y4 >> 8)), r_term, g_term, b_term);
+		dst[i] = (even & 0xFFFF) | odd << 16;            // first block
+		dst[i + 2] = even >> 16 | (odd & 0xFFFF0000); // second block
+	}
+}
+
+void yuv420p_to_bgr565_tiled(const uint8_t *y, const uint8_t *u, const uint8_t *v, int y_line_size, int uv_line_size,
+                             uint16_t *texture, int width, int height, int tex_width, int tex_height) {
+	clip_size(&width, &height, tex_width, tex_height);
+
+	uint32_t *dst = (uint32_t *)texture;
+	int skip_words = (tex_width - width) / 8 * 32; // tiles on the right of the image
+	for (int tile_y = 0; tile_y < height; tile_y += 8) {
+		for (int tile_x = 0; tile_x < width; tile_x += 8) {
+			// the 4x2 pixel groups of a tile in the order they are stored, so that the tile is written sequentially
+			for (int i = 0; i < 8; i++) {
+				int row = tile_y + ((i & 1) | (i >> 2) << 1) * 2;
+				int col = tile_x + (i >> 1 & 1) * 4;
+				const uint8_t *y0 = y + row * y_line_size + col;
+				int uv_offset = row / 2 * uv_line_size + col / 2;
+				convert_4x2(y0, y0 + y_line_size, u + uv_offset, v + uv_offset, dst);
+				dst += 4;
+			}
+		}
+		dst += skip_words;
+	}
+}
+#else
+void yuv420p_to_bgr565_tiled(const uint8_t *y, const uint8_t *u, const uint8_t *v, int y_line_size, int uv_line_size,
+                             uint16_t *texture, int width, int height, int tex_width, int tex_height) {
+	yuv420p_to_bgr565_tiled_ref(y, u, v, y_line_size, uv_line_size, texture, width, height, tex_width, tex_height);
+}
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+
+// YUV420P -> BGR565 written directly in the tiled layout of a GPU texture, in one pass
+// this file depends on nothing but the C standard library so that the SIMD version can be checked against the
+// reference on any host
+//
+// texture layout : 8x8 tiles stored left to right then top to bottom, the 64 pixels of a tile in Morton (Z) order
+// colors : ITU-R BT.709 limited range, 6-bit fixed point
+// `width` and `height` are rounded up to multiples of 8 and clipped to the texture, the planes must cover the rounded
+// up size (decoded frames are padded anyway)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// uses the ARMv6 SIMD instructions if available, otherwise same as yuv420p_to_bgr565_tiled_ref()
+void yuv420p_to_bgr565_tiled(const uint8_t *y, const uint8_t *u, const uint8_t *v, int y_line_size, int uv_line_size,
+                             uint16_t *texture, int width, int height, int tex_width, int tex_height);
+
+// portable reference, the output of yuv420p_to_bgr565_tiled() must be bit-exact with this
+void yuv420p_to_bgr565_tiled_ref(const uint8_t *y, const uint8_t *u, const uint8_t *v, int y_line_size,
+                                 int uv_line_size, uint16_t *texture, int width, int height, int tex_width,
+                                 int tex_height);
+
+#ifdef __cplusplus
+}
+#endif
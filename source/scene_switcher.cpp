@@ -9,6 +9,8 @@
 #include "scenes/home.hpp"
 #include "network_decoder/network_io.hpp"
 #include "network_decoder/thumbnail_loader.hpp"
+#include "network_decoder/stream_cache.hpp"
+#include "network_decoder/offline_download.hpp"
 #include "util/async_task.hpp"
 #include "util/misc_tasks.hpp"
 #include "ui/ui.hpp"
@@ -20,7 +22,8 @@ Intent global_intent;
 namespace SceneSwitcher {
 static bool menu_thread_run = false;
 static bool menu_check_exit_request = false;
-static Thread menu_worker_thread, thumbnail_downloader_thread, async_task_thread, misc_tasks_thread;
+static Thread menu_worker_thread, thumbnail_downloader_thread, thumbnail_decoder_thread, async_task_thread,
+    misc_tasks_thread, stream_cache_thread, offline_download_thread;
 
 static void empty_thread(void *arg) { threadExit(0); }
 
@@ -157,8 +160,15 @@ void Menu_init(void) {
 
 	thumbnail_downloader_thread = threadCreate(thumbnail_downloader_thread_func, (void *)(""), DEF_STACKSIZE,
 	                                           DEF_THREAD_PRIORITY_NORMAL, 0, false);
+	// not bound to a core, it runs on whichever is free
+	thumbnail_decoder_thread =
+	    threadCreate(thumbnail_decoder_thread_func, NULL, DEF_STACKSIZE, DEF_THREAD_PRIORITY_LOW, -1, false);
 	async_task_thread = threadCreate(async_task_thread_func, NULL, DEF_STACKSIZE, DEF_THREAD_PRIORITY_NORMAL, 0, false);
 	misc_tasks_thread = threadCreate(misc_tasks_thread_func, NULL, DEF_STACKSIZE, DEF_THREAD_PRIORITY_NORMAL, 0, false);
+	stream_cache_thread =
+	    threadCreate(stream_cache_thread_func, NULL, DEF_STACKSIZE, DEF_THREAD_PRIORITY_NORMAL, 0, false);
+	offline_download_thread =
+	    threadCreate(offline_download_thread_func, NULL, DEF_STACKSIZE, DEF_THREAD_PRIORITY_LOW, 0, false);
 
 	Menu_get_system_info();
 
@@ -185,8 +195,11 @@ void Menu_exit(void) {
 	Extfont_exit();
 
 	thumbnail_downloader_thread_exit_request();
+	thumbnail_decoder_thread_exit_request();
 	async_task_thread_exit_request();
 	misc_tasks_thread_exit_request();
+	stream_cache_thread_exit_request();
+	offline_download_thread_exit_request();
 	NetworkSessionList::exit_request();
 	unlock_network_state();
 
@@ -194,12 +207,18 @@ void Menu_exit(void) {
 
 	logger.info(DEF_MENU_EXIT_STR, "threadJoin()...", threadJoin(menu_worker_thread, time_out));
 	logger.info(DEF_MENU_EXIT_STR, "threadJoin()...", threadJoin(thumbnail_downloader_thread, time_out));
+	logger.info(DEF_MENU_EXIT_STR, "threadJoin()...", threadJoin(thumbnail_decoder_thread, time_out));
 	logger.info(DEF_MENU_EXIT_STR, "threadJoin()...", threadJoin(async_task_thread, time_out));
 	logger.info(DEF_MENU_EXIT_STR, "threadJoin()...", threadJoin(misc_tasks_thread, time_out));
+	logger.info(DEF_MENU_EXIT_STR, "threadJoin()...", threadJoin(stream_cache_thread, time_out));
+	logger.info(DEF_MENU_EXIT_STR, "threadJoin()...", threadJoin(offline_download_thread, time_out));
 	threadFree(menu_worker_thread);
 	threadFree(thumbnail_downloader_thread);
+	threadFree(thumbnail_decoder_thread);
 	threadFree(async_task_thread);
 	threadFree(misc_tasks_thread);
+	threadFree(stream_cache_thread);
+	threadFree(offline_download_thread);
 
 	NetworkSessionList::at_exit();
 
@@ -283,7 +283,14 @@ void Channel_init(void) {
 	    var_need_refresh = true;
     }
 
-    void Channel_suspend(void) { thread_suspend = true; }
+    void Channel_suspend(void) {
+	    thread_suspend = true;
+	    if (global_intent.next_scene != SceneType::CHANNEL) {
+		    // the channel page itself is kept loading, the rest is loaded again when its view is drawn
+		    cancel_async_tasks({load_channel_more, load_channel_stream, load_channel_stream_more, load_channel_shorts,
+		                        load_channel_shorts_more, load_channel_playlists, load_channel_community_posts});
+	    }
+    }
 
     View *video2view(const YouTubeVideoSuccinct &video) {
 	    return (new SuccinctVideoView(0, 0, 320, VIDEO_LIST_THUMBNAIL_HEIGHT))
@@ -688,6 +695,9 @@ void Channel_init(void) {
     static void load_channel_more(void *) {
 	    auto new_result = channel_info;
 	    new_result.load_more_videos();
+	    if (is_running_async_task_cancelled()) { // the scene was left while loading; loaded again when drawn
+		    return;
+	    }
 
 	    logger.info("channel-c", "truncate start");
 	    std::vector<View *> new_video_views;
@@ -725,6 +735,9 @@ void Channel_init(void) {
 	    add_cpu_limit(ADDITIONAL_CPU_LIMIT);
 	    YouTubeChannelDetail streams_result = youtube_load_channel_streams_page(url);
 	    remove_cpu_limit(ADDITIONAL_CPU_LIMIT);
+	    if (is_running_async_task_cancelled()) { // the scene was left while loading; loaded again when drawn
+		    return;
+	    }
 
 	    logger.info("channel-stream", "truncate start");
 	    std::vector<View *> stream_views;
@@ -792,6 +805,9 @@ void Channel_init(void) {
 
 	    auto new_result = channel_info;
 	    new_result.load_more_streams();
+	    if (is_running_async_task_cancelled()) { // the scene was left while loading; loaded again when drawn
+		    return;
+	    }
 
 	    logger.info("channel-stream-more", "truncate start");
 	    std::vector<View *> new_stream_views;
@@ -829,6 +845,9 @@ void Channel_init(void) {
 	    add_cpu_limit(ADDITIONAL_CPU_LIMIT);
 	    YouTubeChannelDetail shorts_result = youtube_load_channel_shorts_page(url);
 	    remove_cpu_limit(ADDITIONAL_CPU_LIMIT);
+	    if (is_running_async_task_cancelled()) { // the scene was left while loading; loaded again when drawn
+		    return;
+	    }
 
 	    logger.info("channel-shorts", "truncate start");
 	    std::vector<View *> shorts_views;
@@ -891,6 +910,9 @@ void Channel_init(void) {
     static void load_channel_shorts_more(void *) {
 	    auto new_result = channel_info;
 	    new_result.load_more_shorts();
+	    if (is_running_async_task_cancelled()) { // the scene was left while loading; loaded again when drawn
+		    return;
+	    }
 
 	    logger.info("channel-shorts-more", "truncate start");
 	    std::vector<View *> new_shorts_views;
@@ -924,6 +946,9 @@ void Channel_init(void) {
     static void load_channel_playlists(void *) {
 	    auto new_result = channel_info;
 	    new_result.load_playlists();
+	    if (is_running_async_task_cancelled()) { // the scene was left while loading; loaded again when drawn
+		    return;
+	    }
 
 	    logger.info("channel-p", "truncate start");
 	    auto *playlist_tab_view = get_playlist_categories_tab_view(new_result.playlists);
@@ -949,6 +974,9 @@ void Channel_init(void) {
     static void load_channel_community_posts(void *) {
 	    auto new_result = channel_info;
 	    new_result.load_more_community_posts();
+	    if (is_running_async_task_cancelled()) { // the scene was left while loading; loaded again when drawn
+		    return;
+	    }
 
 	    logger.info("channel-com", "truncate start");
 	    std::vector<View *> new_post_views;
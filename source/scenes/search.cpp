@@ -195,12 +195,21 @@ void Search_exit(void) {
 	logger.info("search/exit", "Exited.");
 }
 
-void Search_suspend(void) { thread_suspend = true; }
+void Search_suspend(void) {
+	thread_suspend = true;
+	if (global_intent.next_scene != SceneType::SEARCH) {
+		cancel_async_tasks({load_search_results, load_more_search_results});
+	}
+}
 
 void Search_resume(std::string arg) {
 	(void)arg;
 	overlay_menu_on_resume();
 
+	// the search has been cancelled when the scene was left
+	if (!search_done && cur_search_word != "" && !is_async_task_running(load_search_results)) {
+		queue_async_task(load_search_results, NULL);
+	}
 	thread_suspend = false;
 	var_need_refresh = true;
 }
@@ -298,6 +307,9 @@ static void load_search_results(void *) {
 	add_cpu_limit(ADDITIONAL_CPU_LIMIT);
 	YouTubeSearchResult new_result = youtube_load_search(search_url);
 	remove_cpu_limit(ADDITIONAL_CPU_LIMIT);
+	if (is_running_async_task_cancelled()) { // the scene was left while loading; loaded again on resume
+		return;
+	}
 
 	// wrap and truncate here
 	logger.info("search", "truncate/view creation start");
@@ -323,6 +335,9 @@ static void load_search_results(void *) {
 static void load_more_search_results(void *) {
 	auto new_result = search_result;
 	new_result.load_more_results();
+	if (is_running_async_task_cancelled()) { // the scene was left while loading; loaded again when drawn
+		return;
+	}
 
 	logger.info("search-c", "truncate/view creation start");
 	std::vector<View *> new_result_views;
@@ -646,6 +646,49 @@ void Sem_init(void) {
 							snprintf(ratio_str, 16, "%.2f", var_forward_buffer_ratio);
 							return LOCALIZED(FORWARD_BUFFER_RATIO) + " : " + ratio_str;
 						})
+						->set_on_release([] (const BarView &view) { misc_tasks_request(TASK_SAVE_SETTINGS); }),
+					// Buffer target
+					(new BarView(0, 0, 320, 40))
+						->set_values_sync(10.0, 300.0, &var_buffer_target_seconds)
+						->set_title([] (const BarView &view) {
+							return LOCALIZED(BUFFER_TARGET) + " : " + std::to_string((int) var_buffer_target_seconds) + "s";
+						})
+						->set_on_release([] (const BarView &view) {
+							var_buffer_low_water_seconds = std::min(var_buffer_low_water_seconds, var_buffer_target_seconds);
+							misc_tasks_request(TASK_SAVE_SETTINGS);
+						}),
+					// Buffer refill threshold
+					(new BarView(0, 0, 320, 40))
+						->set_values_sync(5.0, 300.0, &var_buffer_low_water_seconds)
+						->set_title([] (const BarView &view) {
+							return LOCALIZED(BUFFER_LOW_WATER_MARK) + " : " + std::to_string((int) var_buffer_low_water_seconds) + "s";
+						})
+						->set_on_release([] (const BarView &view) {
+							var_buffer_low_water_seconds = std::min(var_buffer_low_water_seconds, var_buffer_target_seconds);
+							misc_tasks_request(TASK_SAVE_SETTINGS);
+						}),
+					// SD card stream cache
+					(new BarView(0, 0, 320, 40))
+						->set_values_sync(0, 2048, &var_stream_cache_size_mb)
+						->set_title([] (const BarView &view) {
+							return LOCALIZED(STREAM_CACHE_SIZE) + " : " +
+								(var_stream_cache_size_mb ? std::to_string(var_stream_cache_size_mb) + " MB" : LOCALIZED(DISABLED));
+						})
+						->set_on_release([] (const BarView &view) { misc_tasks_request(TASK_SAVE_SETTINGS); }),
+					// livestream fragments fetched ahead
+					(new BarView(0, 0, 320, 40))
+						->set_values_sync(1, 8, &var_livestream_prefetch_fragments)
+						->set_title([] (const BarView &view) {
+							return LOCALIZED(LIVESTREAM_PREFETCH_FRAGMENTS) + " : " + std::to_string(var_livestream_prefetch_fragments);
+						})
+						->set_on_release([] (const BarView &view) { misc_tasks_request(TASK_SAVE_SETTINGS); }),
+					// low-latency livestream mode (applied from the next livestream)
+					(new BarView(0, 0, 320, 40))
+						->set_values_sync(0, 4, &var_livestream_low_latency_fragments)
+						->set_title([] (const BarView &view) {
+							return LOCALIZED(LIVESTREAM_LOW_LATENCY) + " : " +
+								(var_livestream_low_latency_fragments ? std::to_string(var_livestream_low_latency_fragments) : LOCALIZED(DISABLED));
+						})
 						->set_on_release([] (const BarView &view) { misc_tasks_request(TASK_SAVE_SETTINGS); })
 				}),
 			// Tab #3 : Data
@@ -11,7 +11,10 @@
 #include "network_decoder/network_io.hpp"
 #include "network_decoder/network_decoder_multiple.hpp"
 #include "network_decoder/thumbnail_loader.hpp"
+#include "network_decoder/stream_cache.hpp"
+#include "network_decoder/offline_download.hpp"
 #include "util/async_task.hpp"
+#include "util/timestamp_parser.hpp"
 #include "util/misc_tasks.hpp"
 #include "util/util.hpp"
 #include "data_io/subscription_util.hpp"
@@ -27,6 +30,7 @@
 #define EQUALIZER_POPUP_HEIGHT (240 - VIDEO_PLAYING_BAR_HEIGHT)
 
 #define MAX_THUMBNAIL_LOAD_REQUEST 12
+#define ADAPTIVE_QUALITY_STALLS_TO_STEP_DOWN 3 // network waits during the playback before lowering the quality
 #define MAX_COMMENT_ICON_LOAD_REQUEST 18
 #define MAX_RETRY_CNT 2 // 3 trials as a total
 
@@ -48,12 +52,15 @@ volatile bool should_suspend_decoding = false;
 volatile bool vid_play_request = false;
 volatile bool vid_seek_request = false;
 volatile bool vid_change_video_request = false;
+volatile bool vid_video_switch_request = false; // the decode thread is about to replace the video stream
 volatile bool vid_pausing = false;
 volatile bool vid_pausing_seek = false;
 volatile bool eof_reached = false;
 volatile bool audio_only_mode = false;
 volatile bool video_skip_drawing = false; // for performance reason, enabled when opening keyboard
 volatile int video_p_value = 360;
+volatile bool adaptive_quality_mode = false;
+int adaptive_quality_max = 0; // lowered each time the adaptive mode steps down, 0 : no limit
 volatile double seek_at_init_request = -1;
 double vid_time[2][320];
 double vid_copy_time[2] = {
@@ -112,6 +119,11 @@ YouTubeVideoDetail playing_video_info;
 std::map<std::string, YouTubeVideoDetail> video_info_cache;
 int video_retry_left = 0;
 
+// likely seek targets of the playing video, whose blocks are downloaded while the playback buffer is full
+Mutex prefetch_lock;
+std::vector<double> prefetch_text_timestamps; // timestamps written in the description and the comments
+double prefetch_drag_timestamp = -1;          // where the seek bar is being dragged, -1 if not grabbed
+
 std::set<PostView *> comment_thumbnail_loaded_list;
 
 std::string channel_id_pressed;
@@ -174,6 +186,7 @@ const char *get_network_waiting_status() {
 void video_set_should_suspend_decoding(bool should_suspend) { should_suspend_decoding = should_suspend; }
 
 static void send_seek_request_wo_lock(double pos);
+static void append_text_timestamps(const std::string &text, std::vector<double> &res);
 static void send_change_video_request(std::string url, bool update_player, bool update_view, bool force_load);
 static void send_change_video_request_wo_lock(std::string url, bool update_player, bool update_view, bool force_load);
 
@@ -278,7 +291,7 @@ debug_info_view =
 	                                     std::to_string(network_decoder.get_raw_buffer_num_max());
                               }}),
                      (new RuleView(0, 0, 320, SMALL_MARGIN * 2)),
-                     (new CustomView(0, 0, 320, 160))->set_draw([](const CustomView &view) {
+                     (new CustomView(0, 0, 320, 220))->set_draw([](const CustomView &view) {
 	                     int y = view.y0;
 
 	                     // decoding time graph
@@ -318,6 +331,45 @@ debug_info_view =
 	                     Draw("Zoom : x" + std::to_string(vid_zoom).substr(0, 5) +
 	                              " X : " + std::to_string((int)vid_x) + " Y : " + std::to_string((int)vid_y),
 	                          0, y + 140, 0.5, 0.5, DEFAULT_TEXT_COLOR);
+	                     auto connection_stats = NetworkSessionList::get_connection_stats();
+	                     Draw("Conn reused : " + std::to_string(connection_stats.reused_connections) +
+	                              " new : " + std::to_string(connection_stats.new_connections) +
+	                              " TLS : " + std::to_string(connection_stats.tls_handshakes),
+	                          0, y + 150, 0.4, 0.4, DEFAULT_TEXT_COLOR);
+	                     Draw("Download : " + std::to_string((int)(stream_downloader.get_recent_throughput() / 1000)) +
+	                              " KB/s (avg : " + std::to_string((int)(stream_downloader.get_throughput() / 1000)) +
+	                              " KB/s) in flight : " + std::to_string(stream_downloader.get_requests_in_flight_num()),
+	                          0, y + 160, 0.4, 0.4, DEFAULT_TEXT_COLOR);
+	                     auto cache_stats = stream_cache_get_stats();
+	                     Draw("SD cache : hit " + std::to_string(cache_stats.hit_num) + " miss " +
+	                              std::to_string(cache_stats.miss_num) + " dropped " +
+	                              std::to_string(cache_stats.dropped_num) + " (" +
+	                              std::to_string(cache_stats.total_size / 1000000) + " MB)",
+	                          0, y + 170, 0.4, 0.4, DEFAULT_TEXT_COLOR);
+	                     Draw("Live fragment : " + std::to_string((int)network_decoder.get_fragment_latency_ms()) +
+	                              " ms (avg : " + std::to_string((int)network_decoder.get_fragment_latency_avg_ms()) +
+	                              " ms) fetched ahead : " + std::to_string(var_livestream_prefetch_fragments),
+	                          0, y + 180, 0.4, 0.4, DEFAULT_TEXT_COLOR);
+	                     double live_latency = network_decoder.get_live_latency();
+	                     double live_target_latency = network_decoder.get_live_target_latency();
+	                     Draw("Live latency : " +
+	                              (live_latency >= 0 ? std::to_string((int)live_latency) + " s" : "N/A") +
+	                              (live_target_latency >= 0
+	                                   ? " (target : " + std::to_string((int)live_target_latency) + " s)" +
+	                                         (network_decoder.is_live_catching_up() ? " catching up" : "")
+	                                   : ""),
+	                          0, y + 190, 0.4, 0.4, DEFAULT_TEXT_COLOR);
+	                     auto alloc_stats = network_decoder_get_alloc_stats();
+	                     Draw("Allocs : packet " + std::to_string(alloc_stats.packet_alloc_num) + " (reused " +
+	                              std::to_string(alloc_stats.packet_reuse_num) + ") frame " +
+	                              std::to_string(alloc_stats.audio_frame_alloc_num),
+	                          0, y + 200, 0.4, 0.4, DEFAULT_TEXT_COLOR);
+	                     auto thumbnail_stats = thumbnail_get_stats();
+	                     Draw("Thumbnails : dl " + std::to_string((int)thumbnail_stats.download_ms) + " ms queue " +
+	                              std::to_string((int)thumbnail_stats.queue_ms) + " ms (" +
+	                              std::to_string(thumbnail_stats.queued_num) + ") decode " +
+	                              std::to_string((int)thumbnail_stats.decode_ms) + " ms",
+	                          0, y + 210, 0.4, 0.4, DEFAULT_TEXT_COLOR);
                      })});
     playback_tab_view =
 	    (new ScrollView(0, 0, 320, CONTENT_Y_HIGH))
@@ -344,6 +396,40 @@ debug_info_view =
 		seek_at_init_request = vid_current_pos;
 		send_change_video_request_wo_lock(cur_playing_url, true, false, true);
 		video_retry_left = MAX_RETRY_CNT;
+	}
+	                 }),
+	             (new EmptyView(0, 0, 320, SMALL_MARGIN)),
+	             (new TextView(SMALL_MARGIN * 2, 0, 200, CONTROL_BUTTON_HEIGHT))
+	                 ->set_text((std::function<std::string()>)[]() {
+	double progress = 0;
+	auto status = offline_download_get_status(playing_video_info.id, &progress);
+	if (status == OfflineDownloadStatus::COMPLETED) {
+		return LOCALIZED(DELETE_OFFLINE_COPY);
+	} else if (status == OfflineDownloadStatus::QUEUED || status == OfflineDownloadStatus::DOWNLOADING) {
+		return LOCALIZED(CANCEL_SAVING_OFFLINE) + " (" + std::to_string((int)progress) + "%)";
+	}
+	return LOCALIZED(SAVE_OFFLINE);
+	                 })
+	                 ->set_x_alignment(TextView::XAlign::CENTER)
+	                 ->set_get_background_color([](const View &) {
+	return playing_video_info.id == "" || playing_video_info.is_livestream ? DEF_DRAW_LIGHT_GRAY : DEF_DRAW_WEAK_GREEN;
+	                 })
+	                 ->set_on_view_released([](View &view) {
+	if (playing_video_info.id == "" || playing_video_info.is_livestream) {
+		return;
+	}
+	auto status = offline_download_get_status(playing_video_info.id);
+	if (status == OfflineDownloadStatus::NONE || status == OfflineDownloadStatus::FAILED) {
+		// the quality being played, or the lowest one in the audio-only mode
+		int quality = playing_video_info.video_stream_urls.count((int)video_p_value) && !audio_only_mode
+		                  ? (int)video_p_value
+		              : playing_video_info.video_stream_urls.size() ? playing_video_info.video_stream_urls.begin()->first
+		                                                             : 0;
+		if (!offline_download_enqueue(playing_video_info, quality)) {
+			logger.warning("player", "this video cannot be saved offline");
+		}
+	} else {
+		offline_download_remove(playing_video_info.id);
 	}
 	                 }),
 	             video_quality_selector_view,
@@ -693,6 +779,10 @@ debug_info_view =
     void VideoPlayer_suspend(void) {
 	    vid_thread_suspend = true;
 	    vid_main_run = false;
+	    if (global_intent.next_scene != SceneType::VIDEO_PLAYER) {
+		    // the playback keeps going in the background, but the lists below the player are not needed meanwhile
+		    cancel_async_tasks({load_more_suggestions, load_more_comments});
+	    }
     }
     void VideoPlayer_resume(std::string arg) {
 	    if (arg != "") {
@@ -880,6 +970,77 @@ debug_info_view =
 	    return result;
     }
 
+    // the highest quality the decoder can keep up with : the Old 3DS decodes in software only,
+    // the New 3DS uses the hardware decoder for 360p and 480p
+    static int get_decodable_quality_max() { return var_is_new3ds ? 480 : 240; }
+    // the highest quality whose bitrate fits in the measured throughput with some margin left, 0 if none is available
+    // without a measurement yet, it starts with the default quality of the model
+    static int choose_adaptive_quality(const YouTubeVideoDetail &video_info) {
+	    constexpr double THROUGHPUT_SAFETY_RATIO = 0.7;
+	    int quality_max = get_decodable_quality_max();
+	    if (adaptive_quality_max > 0) {
+		    quality_max = std::min(quality_max, adaptive_quality_max);
+	    }
+	    double throughput = stream_downloader.get_estimated_throughput() * 8; // bits/s
+	    int res = 0;
+	    for (auto &i : video_info.video_stream_urls) { // ascending order of the quality
+		    if (i.first > quality_max) {
+			    break;
+		    }
+		    if (res == 0) {
+			    res = i.first; // the lowest one is used even if it does not fit
+		    } else if (throughput == 0) {
+			    if (i.first <= (var_is_new3ds ? 360 : 144)) {
+				    res = i.first;
+			    }
+		    } else {
+			    auto bitrate = video_info.video_stream_bitrates.find(i.first);
+			    if (bitrate != video_info.video_stream_bitrates.end() && bitrate->second > 0 &&
+			        bitrate->second + video_info.audio_stream_bitrate <= throughput * THROUGHPUT_SAFETY_RATIO) {
+				    res = i.first;
+			    }
+		    }
+	    }
+	    return res;
+    }
+
+    // called after video_p_value or audio_only_mode has been changed while playing
+    // when only the quality changes, the video stream is switched in the background keeping the audio and the decoder,
+    // otherwise everything is reopened at the current position
+    static void apply_video_quality_change(bool video_was_playing) {
+	    auto video_url = playing_video_info.video_stream_urls.find((int)video_p_value);
+	    if (video_was_playing && !audio_only_mode && video_url != playing_video_info.video_stream_urls.end() &&
+	        network_decoder.is_video_switchable()) {
+		    network_decoder.request_video_switch(video_url->second,
+		                                         var_is_new3ds && (video_p_value == 360 || video_p_value == 480),
+		                                         vid_current_pos);
+	    } else {
+		    seek_at_init_request = vid_current_pos;
+		    vid_change_video_request = true;
+		    if (network_decoder.ready) {
+			    network_decoder.interrupt = true;
+		    }
+	    }
+    }
+    // called when the playback keeps waiting for the network in the adaptive mode
+    // switches to the next lower quality and does not come back above it for this video
+    static void step_down_adaptive_quality() {
+	    int lower_p_value = 0;
+	    for (auto &i : playing_video_info.video_stream_urls) {
+		    if (i.first < video_p_value) {
+			    lower_p_value = i.first;
+		    }
+	    }
+	    network_decoder.stall_num = 0;
+	    if (lower_p_value == 0) {
+		    return; // already the lowest
+	    }
+	    logger.info("adaptive", std::to_string(video_p_value) + "p -> " + std::to_string(lower_p_value) + "p");
+	    adaptive_quality_max = lower_p_value;
+	    video_p_value = lower_p_value;
+	    apply_video_quality_change(true);
+    }
+
     // arg :
     //   cur_playing_url : only update the data for the player
     //   cur_displaying_url : only update the displayed data
@@ -1393,6 +1554,7 @@ debug_info_view =
 
 	    video_quality_selector_view->button_texts = {(std::function<std::string()>)[](){return LOCALIZED(OFF);
     }
+    , (std::function<std::string()>)[]() { return LOCALIZED(AUTO_QUALITY); }
     }
     ;
     for (auto i : available_qualities) {
@@ -1406,8 +1568,20 @@ debug_info_view =
 	    return tmp_video_info.video_stream_urls.count(p_value) ||
 	           ((p_value == 360 || p_value == 480) && tmp_video_info.both_stream_url != "");
     };
+    adaptive_quality_mode = var_video_quality == VIDEO_QUALITY_AUTO;
+    adaptive_quality_max = 0;
     if (var_video_quality == 0) {
 	    audio_only_mode = true;
+    } else if (adaptive_quality_mode) {
+	    audio_only_mode = false;
+	    video_p_value = choose_adaptive_quality(tmp_video_info);
+	    if (video_p_value == 0) {
+		    // no separate video stream to choose from
+		    video_p_value = 360;
+		    if (!var_is_new3ds || !is_available(video_p_value)) {
+			    audio_only_mode = true;
+		    }
+	    }
     } else {
 	    if (!audio_only_mode && !is_available(var_video_quality)) {
 		    video_p_value = var_is_new3ds ? 360 : 144;
@@ -1431,12 +1605,22 @@ debug_info_view =
 	    }
     }
 
+    // a video saved offline is played at the saved quality, from the SD card
+    int offline_quality;
+    if (!audio_only_mode && offline_download_get_local_streams(tmp_video_info.id, &offline_quality, NULL, NULL) &&
+        is_available(offline_quality)) {
+	    adaptive_quality_mode = false;
+	    video_p_value = offline_quality;
+    }
+
     if (audio_only_mode) {
 	    video_quality_selector_view->selected_button = 0;
+    } else if (adaptive_quality_mode) {
+	    video_quality_selector_view->selected_button = 1;
     } else {
 	    auto it = std::find(available_qualities.begin(), available_qualities.end(), (int)video_p_value);
 	    if (it != available_qualities.end()) {
-		    video_quality_selector_view->selected_button = 1 + (it - available_qualities.begin());
+		    video_quality_selector_view->selected_button = 2 + (it - available_qualities.begin());
 	    } else {
 		    auto closest_it = std::min_element(available_qualities.begin(), available_qualities.end(),
 		                                       [video_p_value = video_p_value](int a, int b) {
@@ -1444,7 +1628,7 @@ debug_info_view =
 		                                       });
 		    if (closest_it != available_qualities.end()) {
 			    video_p_value = *closest_it;
-			    video_quality_selector_view->selected_button = 1 + (closest_it - available_qualities.begin());
+			    video_quality_selector_view->selected_button = 2 + (closest_it - available_qualities.begin());
 		    } else {
 			    audio_only_mode = true;
 			    video_quality_selector_view->selected_button = 0;
@@ -1453,27 +1637,35 @@ debug_info_view =
     }
     video_quality_selector_view->set_on_change([available_qualities](const SelectorView &view) {
 	    bool changed = false;
+	    bool video_was_playing = !audio_only_mode;
 	    if (view.selected_button == 0) {
 		    if (!audio_only_mode) {
 			    changed = true;
 		    }
 		    audio_only_mode = true;
+		    adaptive_quality_mode = false;
 	    } else {
-		    int new_p_value = available_qualities[view.selected_button - 1];
+		    int new_p_value;
+		    if (view.selected_button == 1) {
+			    adaptive_quality_max = 0;
+			    new_p_value = choose_adaptive_quality(playing_video_info);
+			    if (new_p_value == 0) {
+				    new_p_value = video_p_value;
+			    }
+		    } else {
+			    new_p_value = available_qualities[view.selected_button - 2];
+		    }
 		    if (audio_only_mode || video_p_value != new_p_value) {
 			    changed = true;
 		    }
 		    audio_only_mode = false;
+		    adaptive_quality_mode = view.selected_button == 1;
 		    video_p_value = new_p_value;
 	    }
 	    if (changed) {
-		    seek_at_init_request = vid_current_pos;
-		    vid_change_video_request = true;
-		    if (network_decoder.ready) {
-			    network_decoder.interrupt = true;
-		    }
+		    apply_video_quality_change(video_was_playing);
 	    }
-	    var_video_quality = audio_only_mode ? 0 : video_p_value;
+	    var_video_quality = audio_only_mode ? 0 : adaptive_quality_mode ? VIDEO_QUALITY_AUTO : video_p_value;
 	    misc_tasks_request(TASK_SAVE_SETTINGS);
     });
     // update playlist tab
@@ -1500,6 +1692,9 @@ debug_info_view =
 	    auto new_result = *arg;
 	    new_result.load_more_suggestions();
 	    remove_cpu_limit(ADDITIONAL_CPU_LIMIT);
+	    if (is_running_async_task_cancelled()) { // the scene was left while loading; loaded again when drawn
+		    return;
+	    }
 
 	    // wrap suggestion titles
 	    logger.info("player/load-s", "truncate/view creation start");
@@ -1534,6 +1729,9 @@ debug_info_view =
 	    auto new_result = *arg;
 	    new_result.load_more_comments();
 	    remove_cpu_limit(ADDITIONAL_CPU_LIMIT);
+	    if (is_running_async_task_cancelled()) { // the scene was left while loading; loaded again when drawn
+		    return;
+	    }
 
 	    std::vector<View *> new_comment_views;
 	    // wrap comments
@@ -1550,6 +1748,16 @@ debug_info_view =
 	    }
 	    cur_video_info = new_result;
 	    video_info_cache[cur_video_info.url] = new_result;
+	    if (network_decoder.ready && cur_video_info.id == playing_video_info.id) {
+		    std::vector<double> text_timestamps;
+		    for (size_t i = arg->comments.size(); i < new_result.comments.size(); i++) {
+			    append_text_timestamps(new_result.comments[i].content, text_timestamps);
+		    }
+		    prefetch_lock.lock();
+		    prefetch_text_timestamps.insert(prefetch_text_timestamps.end(), text_timestamps.begin(),
+		                                    text_timestamps.end());
+		    prefetch_lock.unlock();
+	    }
 	    comments_main_view->views.insert(comments_main_view->views.end(), new_comment_views.begin(),
 	                                     new_comment_views.end());
 	    update_comment_bottom_view();
@@ -1781,6 +1989,45 @@ debug_info_view =
 	    small_resource_lock.unlock();
     }
 
+    // the timestamps (in seconds) written in `text`, appended to `res`
+    static void append_text_timestamps(const std::string &text, std::vector<double> &res) {
+	    int pos = 0;
+	    int start, end;
+	    double seconds;
+	    while (Util_find_timestamp_in_text(text, pos, &start, &end, &seconds) != -1) {
+		    res.push_back(seconds);
+		    pos = end;
+	    }
+    }
+    // passes the likely seek targets to the decoder, the most likely one first
+    static void update_prefetch_times() {
+	    constexpr size_t MAX_PREFETCH_TARGETS = 8;
+	    double cur_pos = vid_current_pos;
+
+	    prefetch_lock.lock();
+	    std::vector<double> text_timestamps = prefetch_text_timestamps;
+	    double drag_timestamp = prefetch_drag_timestamp;
+	    prefetch_lock.unlock();
+
+	    std::vector<double> times;
+	    if (drag_timestamp >= 0) {
+		    times.push_back(drag_timestamp);
+	    }
+	    // ones just ahead are already being buffered
+	    text_timestamps.erase(std::remove_if(text_timestamps.begin(), text_timestamps.end(),
+	                                         [&](double t) { return cur_pos <= t && t < cur_pos + var_buffer_target_seconds; }),
+	                          text_timestamps.end());
+	    std::sort(text_timestamps.begin(), text_timestamps.end(),
+	              [&](double a, double b) { return std::fabs(a - cur_pos) < std::fabs(b - cur_pos); });
+	    for (auto t : text_timestamps) {
+		    if (times.size() >= MAX_PREFETCH_TARGETS) {
+			    break;
+		    }
+		    times.push_back(t);
+	    }
+	    network_decoder.set_prefetch_times(times);
+    }
+
     static void send_seek_request_wo_lock(double pos) {
 	    vid_seek_pos = pos;
 	    vid_current_pos = pos;
@@ -1887,11 +2134,26 @@ debug_info_view =
 	    if (bar_grabbed) {
 		    last_grab_timestamp = network_decoder.get_timestamp_from_bar_pos(
 		        ((key.touch_x != -1 ? key.touch_x : last_touch_x) - bar_x_l) / (bar_x_r - bar_x_l));
+		    // start fetching where the bar is held before it is released
+		    constexpr double DRAG_PREFETCH_MIN_MOVE = 1.0;
+		    prefetch_lock.lock();
+		    bool moved = prefetch_drag_timestamp < 0 ||
+		                 std::fabs(prefetch_drag_timestamp - last_grab_timestamp) > DRAG_PREFETCH_MIN_MOVE;
+		    if (moved) {
+			    prefetch_drag_timestamp = last_grab_timestamp;
+		    }
+		    prefetch_lock.unlock();
+		    if (moved && network_decoder.ready) {
+			    update_prefetch_times();
+		    }
 	    }
 	    if (bar_grabbed && key.touch_x == -1) {
 		    if (network_decoder.ready) {
 			    send_seek_request(last_grab_timestamp);
 		    }
+		    prefetch_lock.lock();
+		    prefetch_drag_timestamp = -1;
+		    prefetch_lock.unlock();
 		    bar_grabbed = false;
 		    var_need_refresh = true;
 	    }
@@ -1981,6 +2243,54 @@ debug_info_view =
 	    }
     }
 
+    static void update_video_format_info() {
+	    auto tmp = network_decoder.get_video_info();
+	    vid_width = vid_width_org = tmp.width;
+	    vid_height = vid_height_org = tmp.height;
+	    vid_framerate = tmp.framerate;
+	    vid_video_format = tmp.format_name;
+	    vid_duration = tmp.duration;
+	    vid_frametime = 1000.0 / vid_framerate;
+
+	    if (vid_width % 16 != 0) {
+		    vid_width += 16 - vid_width % 16;
+	    }
+	    if (vid_height % 16 != 0) {
+		    vid_height += 16 - vid_height % 16;
+	    }
+    }
+    // splices the video stream prepared in the background in, once the converter has shown all the frames of the
+    // current one (the audio keeps going as it is)
+    static void splice_video_switch() {
+	    Result_with_string result;
+	    while (vid_play_request && !vid_seek_request && !vid_change_video_request) {
+		    result = network_decoder.flush_video_decoder();
+		    if (result.code == 0 && !network_decoder.get_raw_buffer_num()) {
+			    break;
+		    }
+		    usleep(10000);
+	    }
+	    if (!vid_play_request || vid_seek_request || vid_change_video_request) {
+		    return; // on seek, the new stream is prepared again for the new position
+	    }
+
+	    vid_video_switch_request = true;
+	    network_decoder_critical_lock.lock(); // the converter thread is now suspended
+	    result = network_decoder.apply_video_switch();
+	    if (result.code == 0) {
+		    update_video_format_info();
+	    }
+	    network_decoder_critical_lock.unlock();
+	    vid_video_switch_request = false;
+
+	    logger.info(DEF_SAPP0_DECODE_THREAD_STR,
+	                "network_decoder.apply_video_switch()..." + result.string + result.error_description, result.code);
+	    if (result.code != 0) { // reopen everything
+		    seek_at_init_request = vid_current_pos;
+		    vid_change_video_request = true;
+	    }
+    }
+
     static void decode_thread(void *arg) {
 	    logger.info(DEF_SAPP0_DECODE_THREAD_STR, "Thread started.");
 
@@ -2041,7 +2351,21 @@ debug_info_view =
 
 			    // video page parsing sometimes randomly fails, so try several times
 			    network_waiting_status = "Reading Stream";
-			    if (audio_only_mode) {
+			    network_decoder.set_cache_video_id(playing_video_info.is_livestream ? "" : playing_video_info.id);
+			    int offline_quality = 0;
+			    std::string offline_video_url, offline_audio_url;
+			    bool offline = !playing_video_info.is_livestream &&
+			                   offline_download_get_local_streams(playing_video_info.id, &offline_quality,
+			                                                      &offline_video_url, &offline_audio_url);
+			    if (offline && (audio_only_mode || video_p_value == offline_quality)) {
+				    // the files saved offline go through the same decoder path, only read from the SD card
+				    if (audio_only_mode) {
+					    result = network_decoder.init(offline_audio_url, stream_downloader, -1, false, var_is_new3ds);
+				    } else {
+					    result = network_decoder.init(offline_video_url, offline_audio_url, stream_downloader, -1,
+					                                  false, var_is_new3ds && (video_p_value == 360 || video_p_value == 480));
+				    }
+			    } else if (audio_only_mode) {
 				    result = network_decoder.init(
 				        playing_video_info.audio_stream_url, stream_downloader,
 				        playing_video_info.is_livestream ? playing_video_info.stream_fragment_len : -1,
@@ -2068,6 +2392,11 @@ debug_info_view =
 
 			    logger.info(DEF_SAPP0_DECODE_THREAD_STR,
 			                "network_decoder.init()..." + result.string + result.error_description, result.code);
+			    // the saved files must not be deleted while they are read
+			    offline_download_set_playing(offline && (audio_only_mode || video_p_value == offline_quality) &&
+			                                         result.code == 0
+			                                     ? playing_video_info.id
+			                                     : "");
 			    if (result.code != 0) {
 				    if (video_retry_left > 0) {
 					    video_retry_left--;
@@ -2093,22 +2422,20 @@ debug_info_view =
 					    vid_duration = tmp.duration;
 				    }
 				    Util_speaker_init(0, ch, vid_sample_rate);
-				    {
-					    auto tmp = network_decoder.get_video_info();
-					    vid_width = vid_width_org = tmp.width;
-					    vid_height = vid_height_org = tmp.height;
-					    vid_framerate = tmp.framerate;
-					    vid_video_format = tmp.format_name;
-					    vid_duration = tmp.duration;
-					    vid_frametime = 1000.0 / vid_framerate;
+				    update_video_format_info();
 
-					    if (vid_width % 16 != 0) {
-						    vid_width += 16 - vid_width % 16;
-					    }
-					    if (vid_height % 16 != 0) {
-						    vid_height += 16 - vid_height % 16;
-					    }
+				    std::vector<double> text_timestamps;
+				    small_resource_lock.lock();
+				    append_text_timestamps(playing_video_info.description, text_timestamps);
+				    for (auto &comment : playing_video_info.comments) {
+					    append_text_timestamps(comment.content, text_timestamps);
 				    }
+				    small_resource_lock.unlock();
+				    prefetch_lock.lock();
+				    prefetch_text_timestamps = text_timestamps;
+				    prefetch_drag_timestamp = -1;
+				    prefetch_lock.unlock();
+				    update_prefetch_times();
 			    }
 
 			    if (seek_at_init_request >= 0) {
@@ -2150,13 +2477,36 @@ debug_info_view =
 					    if (eof_reached) {
 						    vid_pausing = false; // if it was stuck at the end of the video, resume playing after seek
 					    }
+					    update_prefetch_times(); // the targets are ordered by the distance from the position
 					    network_waiting_status = NULL;
 					    var_need_refresh = true;
 				    }
 				    if (vid_change_video_request || !vid_play_request) {
 					    break;
 				    }
+				    if (adaptive_quality_mode && !audio_only_mode &&
+				        network_decoder.stall_num >= ADAPTIVE_QUALITY_STALLS_TO_STEP_DOWN) {
+					    step_down_adaptive_quality();
+					    if (vid_change_video_request) {
+						    break;
+					    }
+				    }
+				    if (network_decoder.check_video_switch_failed()) {
+					    logger.caution(DEF_SAPP0_DECODE_THREAD_STR, "video switch failed, reopening the streams");
+					    seek_at_init_request = vid_current_pos;
+					    vid_change_video_request = true;
+					    break;
+				    }
+				    if (network_decoder.is_video_switch_ready()) {
+					    splice_video_switch();
+					    if (vid_change_video_request || !vid_play_request) {
+						    break;
+					    }
+				    }
 				    vid_duration = network_decoder.get_duration();
+				    if (!vid_pausing) {
+					    network_decoder.update_live_latency(vid_current_pos);
+				    }
 
 				    auto type = network_decoder.next_decode_type();
 
@@ -2198,25 +2548,27 @@ debug_info_view =
 
 				    if (type == NetworkMultipleDecoder::PacketType::AUDIO) {
 					    double pos;
-					    u8 *audio = NULL;
 					    osTickCounterUpdate(&counter0);
-					    result = network_decoder.decode_audio(&audio_size, &audio, &pos);
+					    result = network_decoder.decode_audio(&audio_size, &pos);
 					    osTickCounterUpdate(&counter0);
 					    vid_audio_time = osTickCounterRead(&counter0);
 
 					    if (result.code == 0) {
 						    while (true) {
-							    result = Util_speaker_add_buffer(0, ch, audio, audio_size, pos);
-							    if (result.code == 0 || !vid_play_request || vid_seek_request ||
-							        vid_change_video_request) {
+							    // the PCM is converted straight into the wave buffer
+							    u8 *audio = Util_speaker_reserve_buffer(0, ch, audio_size);
+							    if (audio) {
+								    audio_size = network_decoder.output_decoded_audio(audio);
+								    Util_speaker_commit_buffer(0, ch, audio_size, pos);
+								    break;
+							    }
+							    if (!vid_play_request || vid_seek_request || vid_change_video_request) {
 								    break;
 							    }
 							    // Util_log_save(DEF_SAPP0_DECODE_THREAD_STR, "audio queue full");
 
 							    usleep(10000);
 						    }
-						    free(audio);
-						    audio = NULL;
 					    } else if (result.code != DEF_ERR_NEED_MORE_INPUT) { // ignore NEED_MORE_INPUT error
 						    logger.error(DEF_SAPP0_DECODE_THREAD_STR,
 						                 "Util_audio_decoder_decode()..." + result.string + result.error_description,
@@ -2285,6 +2637,7 @@ debug_info_view =
 			    network_decoder_critical_lock.lock(); // the converter thread is now suspended
 			    network_decoder.deinit();
 			    network_decoder_critical_lock.unlock();
+			    offline_download_set_playing("");
 
 			    var_need_refresh = true;
 			    vid_pausing = false;
@@ -2306,25 +2659,22 @@ debug_info_view =
 
     static void convert_thread(void *arg) {
 	    logger.info(DEF_SAPP0_CONVERT_THREAD_STR, "Thread started.");
-	    u8 *yuv_video = NULL;
+	    AVFrame *yuv_frame = NULL;
 	    u8 *video = NULL;
 	    TickCounter counter0, counter1;
 	    Result_with_string result;
 
 	    osTickCounterStart(&counter0);
 
-	    y2rInit();
-
 	    while (vid_thread_run) {
-		    if (vid_play_request && !vid_seek_request && !vid_change_video_request) {
+		    if (vid_play_request && !vid_seek_request && !vid_change_video_request && !vid_video_switch_request) {
 			    network_decoder_critical_lock.lock();
-			    while (vid_play_request && !vid_seek_request && !vid_change_video_request) {
+			    while (vid_play_request && !vid_seek_request && !vid_change_video_request && !vid_video_switch_request) {
 				    double pts;
 				    do {
 					    osTickCounterUpdate(&counter1);
 					    osTickCounterUpdate(&counter0);
-					    result = network_decoder.get_decoded_video_frame(
-					        vid_width, vid_height, network_decoder.hw_decoder_enabled ? &video : &yuv_video, &pts);
+					    result = network_decoder.get_decoded_video_frame(&video, &yuv_frame, &pts);
 					    osTickCounterUpdate(&counter0);
 					    if (result.code != DEF_ERR_NEED_MORE_INPUT) {
 						    break;
@@ -2334,7 +2684,8 @@ debug_info_view =
 					    } else {
 						    usleep(3000);
 					    }
-				    } while (vid_play_request && !vid_seek_request && !vid_change_video_request && !audio_only_mode);
+				    } while (vid_play_request && !vid_seek_request && !vid_change_video_request && !vid_video_switch_request &&
+				             !audio_only_mode);
 
 				    if (audio_only_mode) {
 					    while (audio_only_mode && vid_play_request && !vid_seek_request && !vid_change_video_request) {
@@ -2346,7 +2697,7 @@ debug_info_view =
 					    }
 					    break;
 				    }
-				    if (!vid_play_request || vid_seek_request || vid_change_video_request) {
+				    if (!vid_play_request || vid_seek_request || vid_change_video_request || vid_video_switch_request) {
 					    break;
 				    }
 				    if (result.code != 0) { // this is an unexpected error
@@ -2357,13 +2708,20 @@ debug_info_view =
 					    break;
 				    }
 
-				    bool video_need_free = false;
+				    bool texture_ready = false; // already converted into vid_image[texture_index_head]
 				    vid_copy_time[0] = osTickCounterRead(&counter0);
 
 				    osTickCounterUpdate(&counter0);
 				    if (!network_decoder.hw_decoder_enabled) {
-					    result = Util_converter_y2r_yuv420p_to_bgr565(yuv_video, &video, vid_width, vid_height, false);
-					    video_need_free = true;
+					    // converted straight into the tiled texture, which is not displayed until texture_index_head is
+					    // flipped below
+					    if (!video_skip_drawing) {
+						    result = Draw_set_texture_data_yuv420p(
+						        &vid_image[texture_index_head], yuv_frame->data[0], yuv_frame->data[1], yuv_frame->data[2],
+						        yuv_frame->linesize[0], yuv_frame->linesize[1], vid_width, vid_height_org, 1024, 1024);
+						    texture_ready = result.code == 0;
+					    }
+					    network_decoder.release_decoded_video_frame();
 				    }
 				    osTickCounterUpdate(&counter0);
 				    vid_convert_time = osTickCounterRead(&counter0);
@@ -2398,15 +2756,17 @@ debug_info_view =
 					    osTickCounterUpdate(&counter0);
 					    osTickCounterUpdate(&counter1);
 
-					    if (!video_skip_drawing) {
+					    if (!video_skip_drawing && (texture_ready || video)) {
 						    vid_tex_width[texture_index_head] = vid_width_org;
 						    vid_tex_height[texture_index_head] = vid_height_org;
-						    result = Draw_set_texture_data(&vid_image[texture_index_head], video, vid_width,
-						                                   vid_height_org, 1024, 1024, GPU_RGB565);
-						    if (result.code != 0) {
-							    logger.error(DEF_SAPP0_CONVERT_THREAD_STR,
-							                 "Draw_set_texture_data()..." + result.string + result.error_description,
-							                 result.code);
+						    if (!texture_ready) {
+							    result = Draw_set_texture_data(&vid_image[texture_index_head], video, vid_width,
+							                                   vid_height_org, 1024, 1024, GPU_RGB565);
+							    if (result.code != 0) {
+								    logger.error(DEF_SAPP0_CONVERT_THREAD_STR,
+								                 "Draw_set_texture_data()..." + result.string + result.error_description,
+								                 result.code);
+							    }
 						    }
 						    texture_index_head = !texture_index_head;
 					    }
@@ -2417,16 +2777,12 @@ debug_info_view =
 					    var_need_refresh = true;
 				    } else {
 					    logger.error(DEF_SAPP0_CONVERT_THREAD_STR,
-					                 "Util_converter_yuv420p_to_bgr565()..." + result.string + result.error_description,
+					                 "Draw_set_texture_data_yuv420p()..." + result.string + result.error_description,
 					                 result.code);
 				    }
 
-				    if (video_need_free) {
-					    free(video);
-				    }
 				    video = NULL;
-				    yuv_video = NULL; // this is the result of network_decoder.get_decoded_video_frame(), so it should
-				                      // not be freed
+				    yuv_frame = NULL; // already given back to the decoder
 
 				    osTickCounterUpdate(&counter1);
 				    cur_convert_time += osTickCounterRead(&counter1);
@@ -2446,8 +2802,6 @@ debug_info_view =
 		    }
 	    }
 
-	    y2rExit();
-
 	    logger.info(DEF_SAPP0_CONVERT_THREAD_STR, "Thread exit.");
 	    threadExit(0);
     }
@@ -66,6 +66,36 @@ Result_with_string Path::read_file(u8 *data, u32 size, u32 &size_read, u64 offse
 	}
 	return res;
 }
+Result_with_string Path::write_file_part(const u8 *data, u32 size, u64 offset) {
+	Result_with_string res;
+	res.string = [&]() -> std::string {
+		errno = 0;
+		FILE *fp = fopen(path.c_str(), "r+b");
+		if (!fp) {
+			return "fopen() failed";
+		}
+		auto tmp = [&]() -> std::string {
+			errno = 0;
+			if (fseek(fp, offset, SEEK_SET) != 0) {
+				return "fseek() failed";
+			}
+			errno = 0;
+			u32 written = fwrite(data, 1, size, fp);
+			if (written < size) {
+				return "fwrite() failed(" + std::to_string(written) + " < " + std::to_string(size) + ")";
+			}
+			return "";
+		}();
+		if (fclose(fp) != 0 && tmp == "") {
+			tmp = "fclose() failed";
+		}
+		return tmp;
+	}();
+	if (res.string != "") {
+		res.code = errno;
+	}
+	return res;
+}
 Result_with_string Path::delete_file() {
 	Result_with_string res;
 	errno = 0;
@@ -8,6 +8,8 @@ struct Path {
 	Path() = default;
 	Path(const std::string &path) : path(path) {}
 	Result_with_string write_file(const u8 *data, u32 size);
+	// overwrites [offset, offset + size) of the file keeping the rest of it, the file must already exist
+	Result_with_string write_file_part(const u8 *data, u32 size, u64 offset);
 	Result_with_string read_file(u8 *data, u32 size, u32 &size_read, u64 offset = 0);
 	template <typename T> Result_with_string read_entire_file(T &resulting_data) {
 		u64 size;
@@ -19,4 +19,24 @@ class Mutex {
 	void unlock() { LightLock_Unlock(&mutex_); }
 };
 
+// auto-reset event : a waiting thread wakes up once signal() is called, and a signal() made while nobody is waiting is
+// kept until the next wait(), so checking a condition and then waiting never misses a notification
+class Event {
+  private:
+	LightEvent event_;
+
+  public:
+	Event() { LightEvent_Init(&event_, RESET_ONESHOT); }
+	// non-copiable, non-movable for the same reason as Mutex
+	Event(const Event &) = delete;
+	Event &operator=(const Event &) = delete;
+	Event(const Event &&) = delete;
+	Event &operator=(const Event &&) = delete;
+
+	void signal() { LightEvent_Signal(&event_); }
+	void wait() { LightEvent_Wait(&event_); }
+	// returns false on timeout
+	bool wait(s64 timeout_ns) { return !LightEvent_WaitTimeout(&event_, timeout_ns); }
+};
+
 void my_assert(bool condition); // causes a data abort
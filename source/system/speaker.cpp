@@ -1,9 +1,42 @@
 #include "headers.hpp"
 
 #define BUFFER_SIZE 180
-
-ndspWaveBuf util_ndsp_buffer[24][BUFFER_SIZE];
-double util_ndsp_buffer_timestamp[24][BUFFER_SIZE]; // {pts, sample rate}
+#define CHANNEL_NUM 24
+// the PCM of the queued wave buffers lives in one ring of linear memory per channel, allocated by Util_speaker_init()
+#define RING_SECONDS 4
+#define RING_ALIGN 32
+
+ndspWaveBuf util_ndsp_buffer[CHANNEL_NUM][BUFFER_SIZE];
+double util_ndsp_buffer_timestamp[CHANNEL_NUM][BUFFER_SIZE]; // {pts, sample rate}
+
+// the wave buffers are added to ndsp in the order of the slots, and ndsp plays them in that order
+// so the slots in use are always [tail, tail + queued_num) (mod BUFFER_SIZE) and their data follows the same order in
+// the ring
+struct SpeakerRing {
+	u8 *data = NULL;
+	u32 size = 0;
+	u32 write_offset = 0; // where the data of the next slot starts
+	u32 reserved_offset = 0;
+	int head = 0; // the next slot to be queued
+	int tail = 0; // the oldest slot not reclaimed yet
+	volatile int queued_num = 0;
+	u32 slot_offset[BUFFER_SIZE];
+};
+static SpeakerRing util_speaker_ring[CHANNEL_NUM];
+
+static u32 align_ring_size(u32 size) { return (size + RING_ALIGN - 1) / RING_ALIGN * RING_ALIGN; }
+
+// frees the slots ndsp is done with, should be called from the thread adding the buffers
+static void reclaim_done_buffers(int play_ch) {
+	SpeakerRing &ring = util_speaker_ring[play_ch];
+	while (ring.queued_num && util_ndsp_buffer[play_ch][ring.tail].status == NDSP_WBUF_DONE) {
+		ring.tail = (ring.tail + 1) % BUFFER_SIZE;
+		ring.queued_num--;
+	}
+	if (!ring.queued_num) {
+		ring.write_offset = 0;
+	}
+}
 
 void Util_speaker_init(int play_ch, int music_ch, int sample_rate) {
 	float mix[12] = {
@@ -27,41 +60,73 @@ void Util_speaker_init(int play_ch, int music_ch, int sample_rate) {
 	for (int i = 0; i < BUFFER_SIZE; i++) {
 		util_ndsp_buffer[play_ch][i].data_vaddr = NULL;
 	}
-}
-
-Result_with_string Util_speaker_add_buffer(int play_ch, int music_ch, u8 *buffer, int size, double pts) {
-	Result_with_string result;
-	int free_queue = -1;
 
-	for (int i = 0; i < BUFFER_SIZE; i++) {
-		if (util_ndsp_buffer[play_ch][i].status == NDSP_WBUF_FREE ||
-		    util_ndsp_buffer[play_ch][i].status == NDSP_WBUF_DONE) {
-			free_queue = i;
-			break;
+	SpeakerRing &ring = util_speaker_ring[play_ch];
+	u32 ring_size = align_ring_size(sample_rate * music_ch * 2 * RING_SECONDS);
+	if (ring.size != ring_size) {
+		linearFree_concurrent(ring.data);
+		ring.data = (u8 *)linearAlloc_concurrent(ring_size);
+		ring.size = ring.data ? ring_size : 0;
+		if (!ring.data) {
+			logger.error("speaker", "failed to allocate the ring of " + std::to_string(ring_size) + " bytes");
 		}
 	}
+	ring.write_offset = 0;
+	ring.head = ring.tail = ring.queued_num = 0;
+}
 
-	if (free_queue == -1) {
-		result.code = DEF_ERR_OTHER;
-		result.string = "[Error] Queues are full ";
-		return result;
+u8 *Util_speaker_reserve_buffer(int play_ch, int music_ch, int size) {
+	SpeakerRing &ring = util_speaker_ring[play_ch];
+	reclaim_done_buffers(play_ch);
+	if (!ring.data || ring.queued_num >= BUFFER_SIZE) {
+		return NULL;
 	}
 
-	linearFree_concurrent((void *)util_ndsp_buffer[play_ch][free_queue].data_vaddr);
-	util_ndsp_buffer[play_ch][free_queue].data_vaddr = NULL;
-	util_ndsp_buffer[play_ch][free_queue].data_vaddr = (u8 *)linearAlloc_concurrent(size * music_ch);
-	if (util_ndsp_buffer[play_ch][free_queue].data_vaddr == NULL) {
-		result.code = DEF_ERR_OUT_OF_LINEAR_MEMORY;
-		result.string = DEF_ERR_OUT_OF_LINEAR_MEMORY_STR;
-		return result;
+	u32 required = size * music_ch;
+	u32 read_offset = ring.queued_num ? ring.slot_offset[ring.tail] : 0;
+	u32 offset;
+	if (!ring.queued_num || ring.write_offset > read_offset) { // the data in use does not wrap around
+		if (ring.write_offset + required <= ring.size) {
+			offset = ring.write_offset;
+		} else if (ring.queued_num && required <= read_offset) {
+			offset = 0; // the rest of the ring is left unused until the next round
+		} else {
+			return NULL;
+		}
+	} else if (ring.write_offset + required <= read_offset) {
+		offset = ring.write_offset;
+	} else {
+		return NULL;
 	}
+	ring.reserved_offset = offset;
+	return ring.data + offset;
+}
 
-	memcpy((void *)util_ndsp_buffer[play_ch][free_queue].data_vaddr, buffer, size * music_ch);
+void Util_speaker_commit_buffer(int play_ch, int music_ch, int size, double pts) {
+	SpeakerRing &ring = util_speaker_ring[play_ch];
+	ndspWaveBuf &buffer = util_ndsp_buffer[play_ch][ring.head];
+
+	buffer.data_vaddr = ring.data + ring.reserved_offset;
+	buffer.nsamples = size / 2;
+	util_ndsp_buffer_timestamp[play_ch][ring.head] = pts;
+	ring.slot_offset[ring.head] = ring.reserved_offset;
+	ring.write_offset = ring.reserved_offset + align_ring_size(size * music_ch);
+	ring.head = (ring.head + 1) % BUFFER_SIZE;
+	ring.queued_num++;
+	ndspChnWaveBufAdd(play_ch, &buffer);
+}
 
-	util_ndsp_buffer[play_ch][free_queue].nsamples = size / 2;
-	ndspChnWaveBufAdd(play_ch, &util_ndsp_buffer[play_ch][free_queue]);
+Result_with_string Util_speaker_add_buffer(int play_ch, int music_ch, u8 *buffer, int size, double pts) {
+	Result_with_string result;
 
-	util_ndsp_buffer_timestamp[play_ch][free_queue] = pts;
+	u8 *dst = Util_speaker_reserve_buffer(play_ch, music_ch, size);
+	if (!dst) {
+		result.code = DEF_ERR_OTHER;
+		result.string = "[Error] Queues are full ";
+		return result;
+	}
+	memcpy(dst, buffer, size * music_ch);
+	Util_speaker_commit_buffer(play_ch, music_ch, size, pts);
 	return result;
 }
 
@@ -69,18 +134,18 @@ double Util_speaker_get_current_timestamp(int play_ch, int sample_rate) {
 	if (!Util_speaker_is_playing(play_ch)) {
 		return -1;
 	}
-	double queued_min = INFINITY;
-	for (int i = 0; i < BUFFER_SIZE; i++) {
-		if (util_ndsp_buffer[play_ch][i].status == NDSP_WBUF_PLAYING) {
-			return util_ndsp_buffer_timestamp[play_ch][i] + (double)ndspChnGetSamplePos(play_ch) / sample_rate;
+	// the first slot ndsp is not done with is the one playing, or the one to be played next
+	SpeakerRing &ring = util_speaker_ring[play_ch];
+	int queued_num = ring.queued_num;
+	int slot = ring.tail;
+	for (int i = 0; i < queued_num; i++, slot = (slot + 1) % BUFFER_SIZE) {
+		if (util_ndsp_buffer[play_ch][slot].status == NDSP_WBUF_PLAYING) {
+			return util_ndsp_buffer_timestamp[play_ch][slot] + (double)ndspChnGetSamplePos(play_ch) / sample_rate;
 		}
-		if (util_ndsp_buffer[play_ch][i].status == NDSP_WBUF_QUEUED) {
-			queued_min = std::min(queued_min, util_ndsp_buffer_timestamp[play_ch][i]);
+		if (util_ndsp_buffer[play_ch][slot].status == NDSP_WBUF_QUEUED) {
+			return util_ndsp_buffer_timestamp[play_ch][slot];
 		}
 	}
-	if (queued_min != INFINITY) {
-		return queued_min;
-	}
 	// weired...
 	if (!Util_speaker_is_playing(play_ch)) {
 		return -1;
@@ -99,6 +164,9 @@ void Util_speaker_clear_buffer(int play_ch) {
 		util_ndsp_buffer[play_ch][i].status = NDSP_WBUF_FREE;
 		util_ndsp_buffer_timestamp[play_ch][i] = 0.0;
 	}
+	SpeakerRing &ring = util_speaker_ring[play_ch];
+	ring.write_offset = 0;
+	ring.head = ring.tail = ring.queued_num = 0;
 }
 
 void Util_speaker_pause(int play_ch) { ndspChnSetPaused(play_ch, true); }
@@ -113,15 +181,22 @@ void Util_speaker_exit(int play_ch) {
 	ndspChnWaveBufClear(play_ch);
 	ndspChnSetPaused(play_ch, false);
 	for (int i = 0; i < BUFFER_SIZE; i++) {
-		linearFree_concurrent((void *)util_ndsp_buffer[play_ch][i].data_vaddr);
 		util_ndsp_buffer[play_ch][i].data_vaddr = NULL;
 	}
+	SpeakerRing &ring = util_speaker_ring[play_ch];
+	linearFree_concurrent(ring.data);
+	ring.data = NULL;
+	ring.size = 0;
+	ring.write_offset = 0;
+	ring.head = ring.tail = ring.queued_num = 0;
 }
 
 bool Util_speaker_is_buffer_empty(int play_ch) {
-	for (int i = 0; i < BUFFER_SIZE; i++) {
-		if (util_ndsp_buffer[play_ch][i].status == NDSP_WBUF_QUEUED ||
-		    util_ndsp_buffer[play_ch][i].status == NDSP_WBUF_PLAYING) {
+	SpeakerRing &ring = util_speaker_ring[play_ch];
+	int slot = ring.tail;
+	for (int i = 0; i < ring.queued_num; i++, slot = (slot + 1) % BUFFER_SIZE) {
+		if (util_ndsp_buffer[play_ch][slot].status == NDSP_WBUF_QUEUED ||
+		    util_ndsp_buffer[play_ch][slot].status == NDSP_WBUF_PLAYING) {
 			return false;
 		}
 	}
@@ -3,8 +3,15 @@
 
 void Util_speaker_init(int play_ch, int music_ch, int sample_rate);
 
+// `size` : the size of the PCM per channel in bytes
 Result_with_string Util_speaker_add_buffer(int play_ch, int music_ch, u8 *buffer, int size, double pts);
 
+// to write the PCM straight into the wave buffer instead of passing it to Util_speaker_add_buffer()
+// returns where to write `size` bytes per channel, or NULL if the queue is full
+u8 *Util_speaker_reserve_buffer(int play_ch, int music_ch, int size);
+// queues the buffer returned by the last Util_speaker_reserve_buffer(), `size` must not exceed the reserved one
+void Util_speaker_commit_buffer(int play_ch, int music_ch, int size, double pts);
+
 double Util_speaker_get_current_timestamp(int play_ch, int sample_rate);
 
 void Util_speaker_clear_buffer(int play_ch);
@@ -1,5 +1,7 @@
 #include "headers.hpp"
 #include "ui/colors.hpp"
+#include "network_decoder/yuv_tiled.h"
+#include "ui/draw/swizzle.hpp"
 
 namespace Draw_ {
 double draw_frametime[20] = {
@@ -42,18 +44,6 @@ double Draw_query_fps(void) {
 	return 1000.0 / (cache / 20);
 }
 
-extern "C" void memcpy_asm_4b(u8 *, u8 *);
-
-int Draw_convert_to_pos(int height, int width, int img_height, int img_width, int pixel_size) {
-	int pos = img_width * height;
-	if (pos == 0) {
-		pos = img_width;
-	}
-
-	pos -= (img_width - width) - img_width;
-	return pos * pixel_size;
-}
-
 Result_with_string Draw_set_texture_data(Image_data *c2d_image, u8 *buf, int pic_width, int pic_height, int tex_size_x,
                                          int tex_size_y, GPU_TEXCOLOR color_format) {
 	return Draw_set_texture_data(c2d_image, buf, pic_width, pic_height, 0, 0, tex_size_x, tex_size_y, color_format);
@@ -64,14 +54,6 @@ Result_with_string Draw_set_texture_data(Image_data *c2d_image, u8 *buf, int pic
                                          GPU_TEXCOLOR color_format) {
 	int x_max = 0;
 	int y_max = 0;
-	int increase_list_x[tex_size_x + 8]; //= { 4, 12, 4, 44, }
-	int increase_list_y[tex_size_y + 8]; //= { 2, 6, 2, 22, 2, 6, 2, tex_size_x * 8 - 42, };
-	int count[2] = {
-	    0,
-	    0,
-	};
-	int c3d_pos = 0;
-	int c3d_offset = 0;
 	int pixel_size = 0;
 	Result_with_string result;
 
@@ -87,23 +69,6 @@ Result_with_string Draw_set_texture_data(Image_data *c2d_image, u8 *buf, int pic
 		return result;
 	}
 
-	for (int i = 0; i <= tex_size_x; i += 4) {
-		increase_list_x[i] = 4 * pixel_size;
-		increase_list_x[i + 1] = 12 * pixel_size;
-		increase_list_x[i + 2] = 4 * pixel_size;
-		increase_list_x[i + 3] = 44 * pixel_size;
-	}
-	for (int i = 0; i <= tex_size_y; i += 8) {
-		increase_list_y[i] = 2 * pixel_size;
-		increase_list_y[i + 1] = 6 * pixel_size;
-		increase_list_y[i + 2] = 2 * pixel_size;
-		increase_list_y[i + 3] = 22 * pixel_size;
-		increase_list_y[i + 4] = 2 * pixel_size;
-		increase_list_y[i + 5] = 6 * pixel_size;
-		increase_list_y[i + 6] = 2 * pixel_size;
-		increase_list_y[i + 7] = (tex_size_x * 8 - 42) * pixel_size;
-	}
-
 	if (parse_start_width > pic_width || parse_start_height > pic_height) {
 		result.code = DEF_ERR_INVALID_ARG;
 		result.string = DEF_ERR_INVALID_ARG_STR;
@@ -127,62 +92,93 @@ Result_with_string Draw_set_texture_data(Image_data *c2d_image, u8 *buf, int pic
 	c2d_image->subtex->bottom = 1.0 - y_max / (float)tex_size_y;
 	c2d_image->c2d.subtex = c2d_image->subtex;
 
+	u8 *tex = (u8 *)c2d_image->c2d.tex->data;
+	u8 *src = buf + (parse_start_height * pic_width + parse_start_width) * pixel_size;
+	int src_stride = pic_width * pixel_size;
 	if (pixel_size == 2) {
-		for (int k = 0; k < y_max; k++) {
-			for (int i = 0; i < x_max; i += 2) {
-				memcpy_asm_4b(&(((u8 *)c2d_image->c2d.tex->data)[c3d_pos + c3d_offset]),
-				              &(((u8 *)buf)[Draw_convert_to_pos(k + parse_start_height, i + parse_start_width,
-				                                                pic_height, pic_width, pixel_size)]));
-				c3d_pos += increase_list_x[count[0]];
-				count[0]++;
-			}
-			count[0] = 0;
-			c3d_pos = 0;
-			c3d_offset += increase_list_y[count[1]];
-			count[1]++;
-		}
-		c3d_offset += increase_list_y[count[1]];
-		count[1]++;
-	}
-
-	else if (pixel_size == 3) {
-		for (int k = 0; k < y_max; k++) {
-			for (int i = 0; i < x_max; i += 2) {
-				memcpy_asm_4b(&(((u8 *)c2d_image->c2d.tex->data)[c3d_pos + c3d_offset]),
-				              &(((u8 *)buf)[Draw_convert_to_pos(k + parse_start_height, i + parse_start_width,
-				                                                pic_height, pic_width, pixel_size)]));
-				memcpy(&(((u8 *)c2d_image->c2d.tex->data)[c3d_pos + c3d_offset + 4]),
-				       &(((u8 *)buf)[Draw_convert_to_pos(k + parse_start_height, i + parse_start_width, pic_height,
-				                                         pic_width, pixel_size) +
-				                     4]),
-				       2);
-				c3d_pos += increase_list_x[count[0]];
-				count[0]++;
-			}
-			count[0] = 0;
-			c3d_pos = 0;
-			c3d_offset += increase_list_y[count[1]];
-			count[1]++;
-		}
+		swizzle_to_texture<2>(tex, src, src_stride, x_max, y_max, tex_size_x);
+	} else if (pixel_size == 3) {
+		swizzle_to_texture<3>(tex, src, src_stride, x_max, y_max, tex_size_x);
 	} else if (pixel_size == 4) {
-		for (int k = 0; k < y_max; k++) {
-			for (int i = 0; i < x_max; i += 2) {
-				memcpy_asm_4b(&(((u8 *)c2d_image->c2d.tex->data)[c3d_pos + c3d_offset]),
-				              &(((u8 *)buf)[Draw_convert_to_pos(k + parse_start_height, i + parse_start_width,
-				                                                pic_height, pic_width, pixel_size)]));
-				memcpy_asm_4b(&(((u8 *)c2d_image->c2d.tex->data)[c3d_pos + c3d_offset + 4]),
-				              &(((u8 *)buf)[Draw_convert_to_pos(k + parse_start_height, i + parse_start_width,
-				                                                pic_height, pic_width, pixel_size) +
-				                            4]));
-				c3d_pos += increase_list_x[count[0]];
-				count[0]++;
-			}
-			count[0] = 0;
-			c3d_pos = 0;
-			c3d_offset += increase_list_y[count[1]];
-			count[1]++;
-		}
+		swizzle_to_texture<4>(tex, src, src_stride, x_max, y_max, tex_size_x);
+	}
+
+	C3D_TexFlush(c2d_image->c2d.tex);
+
+	return result;
+}
+
+Result_with_string Draw_set_texture_sub_data(Image_data *c2d_image, u8 *buf, int pic_width, int pic_height, int tex_x,
+                                             int tex_y, GPU_TEXCOLOR color_format) {
+	Result_with_string result;
+	C3D_Tex *tex = c2d_image->c2d.tex;
+	int pixel_size = 0;
+
+	if (color_format == GPU_RGB8) {
+		pixel_size = 3;
+	} else if (color_format == GPU_RGB565) {
+		pixel_size = 2;
+	} else if (color_format == GPU_RGBA8) {
+		pixel_size = 4;
 	}
+	if (!pixel_size || tex->fmt != color_format || tex_x % 8 || tex_y % 8 || tex_x < 0 || tex_y < 0 ||
+	    tex_x >= tex->width || tex_y >= tex->height) {
+		result.code = DEF_ERR_INVALID_ARG;
+		result.string = DEF_ERR_INVALID_ARG_STR;
+		return result;
+	}
+
+	int x_max = std::min(pic_width, tex->width - tex_x);
+	int y_max = std::min(pic_height, tex->height - tex_y);
+	c2d_image->subtex->width = (u16)x_max;
+	c2d_image->subtex->height = (u16)y_max;
+	c2d_image->subtex->left = tex_x / (float)tex->width;
+	c2d_image->subtex->top = 1.0 - tex_y / (float)tex->height;
+	c2d_image->subtex->right = (tex_x + x_max) / (float)tex->width;
+	c2d_image->subtex->bottom = 1.0 - (tex_y + y_max) / (float)tex->height;
+	c2d_image->c2d.subtex = c2d_image->subtex;
+
+	int tile_row_size = tex->width * 8 * pixel_size;
+	u8 *dst = (u8 *)tex->data + tex_y / 8 * tile_row_size + tex_x / 8 * 64 * pixel_size;
+	if (pixel_size == 2) {
+		swizzle_to_texture<2>(dst, buf, pic_width * pixel_size, x_max, y_max, tex->width);
+	} else if (pixel_size == 3) {
+		swizzle_to_texture<3>(dst, buf, pic_width * pixel_size, x_max, y_max, tex->width);
+	} else {
+		swizzle_to_texture<4>(dst, buf, pic_width * pixel_size, x_max, y_max, tex->width);
+	}
+
+	// the area is not contiguous, flush it one row of tiles at a time
+	for (int y = 0; y < y_max; y += 8) {
+		GSPGPU_FlushDataCache(dst + y / 8 * tile_row_size, (x_max + 7) / 8 * 64 * pixel_size);
+	}
+
+	return result;
+}
+
+Result_with_string Draw_set_texture_data_yuv420p(Image_data *c2d_image, u8 *y, u8 *u, u8 *v, int y_line_size,
+                                                 int uv_line_size, int pic_width, int pic_height, int tex_size_x,
+                                                 int tex_size_y) {
+	Result_with_string result;
+
+	if (c2d_image->c2d.tex->fmt != GPU_RGB565) {
+		result.code = DEF_ERR_INVALID_ARG;
+		result.string = DEF_ERR_INVALID_ARG_STR;
+		return result;
+	}
+
+	int x_max = std::min(pic_width, tex_size_x);
+	int y_max = std::min(pic_height, tex_size_y);
+	c2d_image->subtex->width = (u16)x_max;
+	c2d_image->subtex->height = (u16)y_max;
+	c2d_image->subtex->left = 0.0;
+	c2d_image->subtex->top = 1.0;
+	c2d_image->subtex->right = x_max / (float)tex_size_x;
+	c2d_image->subtex->bottom = 1.0 - y_max / (float)tex_size_y;
+	c2d_image->c2d.subtex = c2d_image->subtex;
+
+	yuv420p_to_bgr565_tiled(y, u, v, y_line_size, uv_line_size, (u16 *)c2d_image->c2d.tex->data, pic_width, pic_height,
+	                        tex_size_x, tex_size_y);
 
 	C3D_TexFlush(c2d_image->c2d.tex);
 
@@ -12,6 +12,16 @@ Result_with_string Draw_set_texture_data(Image_data *c2d_image, u8 *buf, int pic
                                          int parse_start_width, int parse_start_height, int tex_size_x, int tex_size_y,
                                          GPU_TEXCOLOR color_format);
 
+// writes the image at (`tex_x`, `tex_y`) of a texture shared by several images, both must be multiples of 8
+// c2d_image->subtex is set to that area and only that area is flushed
+Result_with_string Draw_set_texture_sub_data(Image_data *c2d_image, u8 *buf, int pic_width, int pic_height, int tex_x,
+                                             int tex_y, GPU_TEXCOLOR color_format);
+
+// converts the YUV420P image into the texture in one pass, the texture must be GPU_RGB565
+Result_with_string Draw_set_texture_data_yuv420p(Image_data *c2d_image, u8 *y, u8 *u, u8 *v, int y_line_size,
+                                                 int uv_line_size, int pic_width, int pic_height, int tex_size_x,
+                                                 int tex_size_y);
+
 void Draw_c2d_image_set_filter(Image_data *c2d_image, bool filter);
 
 Result_with_string Draw_c2d_image_init(Image_data *c2d_image, int tex_size_x, int tex_size_y,
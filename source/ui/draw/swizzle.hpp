@@ -0,0 +1,57 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+// copies a linear image into the tiled layout of a GPU texture : 8x8 tiles stored left to right then top to bottom,
+// the 64 pixels of a tile in Morton (Z) order
+// this file depends on nothing but the standard library so that it can be checked against the previous
+// implementation on any host (see tests/)
+
+namespace swizzle {
+// the offsets (in pixels) of each column and row inside a tile
+static constexpr int tile_offset_x[8] = {0, 1, 4, 5, 16, 17, 20, 21};
+static constexpr int tile_offset_y[8] = {0, 2, 8, 10, 32, 34, 40, 42};
+
+template <int pixel_size> static inline void full_tile(uint8_t *tile, const uint8_t *src, int src_stride) {
+	for (int y = 0; y < 8; y++) {
+		uint8_t *dst = tile + tile_offset_y[y] * pixel_size;
+		// pairs of horizontally adjacent pixels are adjacent in the tile as well
+		for (int x = 0; x < 8; x += 2) {
+			memcpy(dst + tile_offset_x[x] * pixel_size, src + x * pixel_size, pixel_size * 2);
+		}
+		src += src_stride;
+	}
+}
+
+template <int pixel_size>
+static inline void partial_tile(uint8_t *tile, const uint8_t *src, int src_stride, int width, int height) {
+	for (int y = 0; y < height; y++) {
+		uint8_t *dst = tile + tile_offset_y[y] * pixel_size;
+		for (int x = 0; x < width; x++) {
+			memcpy(dst + tile_offset_x[x] * pixel_size, src + x * pixel_size, pixel_size);
+		}
+		src += src_stride;
+	}
+}
+} // namespace swizzle
+
+// `width` x `height` pixels from `src` (`src_stride` bytes per row) to the top-left of `tex` (`tex_width` pixels wide)
+template <int pixel_size>
+static void swizzle_to_texture(uint8_t *tex, const uint8_t *src, int src_stride, int width, int height, int tex_width) {
+	for (int tile_y = 0; tile_y < height; tile_y += 8) {
+		uint8_t *tile = tex + tile_y * tex_width * pixel_size;
+		const uint8_t *src_tile = src + tile_y * src_stride;
+		int tile_height = std::min(height - tile_y, 8);
+		for (int tile_x = 0; tile_x < width; tile_x += 8) {
+			int tile_width = std::min(width - tile_x, 8);
+			if (tile_width == 8 && tile_height == 8) {
+				swizzle::full_tile<pixel_size>(tile, src_tile, src_stride);
+			} else {
+				swizzle::partial_tile<pixel_size>(tile, src_tile, src_stride, tile_width, tile_height);
+			}
+			tile += 64 * pixel_size;
+			src_tile += 8 * pixel_size;
+		}
+	}
+}
@@ -1,15 +1,24 @@
 #include "async_task.hpp"
 #include "headers.hpp"
+#include "network_decoder/network_io.hpp"
+#include "youtube_parser/parser.hpp"
 #include <deque>
-#include <utility>
+#include <memory>
+
+struct AsyncTask {
+	AsyncTaskFuncType func;
+	void *arg;
+	std::shared_ptr<NetworkCancelToken> cancel_token;
+};
 
 static Mutex resource_lock;
-static std::deque<std::pair<AsyncTaskFuncType, void *>> task_queue; // task_queue.front() is the task currently running
+static std::deque<AsyncTask> task_queue; // task_queue.front() is the task currently running
+static std::shared_ptr<NetworkCancelToken> running_task_cancel_token;
 
 void remove_all_async_tasks_with_type(AsyncTaskFuncType func) {
 	resource_lock.lock();
 	for (auto itr = task_queue.begin(); itr != task_queue.end();) {
-		if (itr != task_queue.begin() && itr->first == func) {
+		if (itr != task_queue.begin() && itr->func == func) {
 			itr = task_queue.erase(itr);
 		} else {
 			itr++;
@@ -18,9 +27,31 @@ void remove_all_async_tasks_with_type(AsyncTaskFuncType func) {
 	resource_lock.unlock();
 }
 
+void cancel_async_tasks(const std::vector<AsyncTaskFuncType> &funcs) {
+	resource_lock.lock();
+	for (auto itr = task_queue.begin(); itr != task_queue.end();) {
+		if (std::find(funcs.begin(), funcs.end(), itr->func) == funcs.end()) {
+			itr++;
+		} else if (itr == task_queue.begin()) {
+			itr->cancel_token->cancel();
+			itr++;
+		} else {
+			itr = task_queue.erase(itr);
+		}
+	}
+	resource_lock.unlock();
+}
+
+bool is_running_async_task_cancelled() {
+	resource_lock.lock();
+	bool res = running_task_cancel_token && running_task_cancel_token->is_cancelled();
+	resource_lock.unlock();
+	return res;
+}
+
 void queue_async_task(AsyncTaskFuncType func, void *arg) {
 	resource_lock.lock();
-	task_queue.push_back({func, arg});
+	task_queue.push_back({func, arg, std::make_shared<NetworkCancelToken>()});
 	resource_lock.unlock();
 }
 
@@ -28,7 +59,7 @@ int is_async_task_running(AsyncTaskFuncType func) {
 	int res = 0;
 	resource_lock.lock();
 	for (int i = 0; i < (int)task_queue.size(); i++) {
-		if (task_queue[i].first == func) {
+		if (task_queue[i].func == func) {
 			res = i ? 1 : 2;
 			break;
 		}
@@ -48,16 +79,21 @@ void async_task_thread_func(void *arg) {
 
 		resource_lock.lock();
 		if (task_queue.size()) {
-			func = task_queue.front().first;
-			arg = task_queue.front().second;
+			func = task_queue.front().func;
+			arg = task_queue.front().arg;
+			running_task_cancel_token = task_queue.front().cancel_token;
 		}
 		resource_lock.unlock();
 
 		if (func) {
+			// every request the task makes through the parser shares the cancel token of the task
+			youtube_set_cancel_token(running_task_cancel_token);
 			func(arg);
+			youtube_set_cancel_token(NULL);
 
 			resource_lock.lock();
 			task_queue.pop_front();
+			running_task_cancel_token = NULL;
 			resource_lock.unlock();
 		} else {
 			usleep(50000);
@@ -1,10 +1,20 @@
 #pragma once
+#include <vector>
 
 using AsyncTaskFuncType = void (*)(void *);
 
 // remove all tasks where the specified function is to be run
 void remove_all_async_tasks_with_type(AsyncTaskFuncType func);
 
+// remove all queued tasks where one of the specified functions is to be run, and abort the network requests
+// of the running one if it is one of them (the running task itself still runs to the end)
+// meant to be called when a scene is suspended, for the tasks whose results are no longer needed right away
+void cancel_async_tasks(const std::vector<AsyncTaskFuncType> &funcs);
+
+// check if the task currently running has been cancelled; only meaningful when called from the task itself
+// a cancelled task should discard its (failed) result instead of storing it
+bool is_running_async_task_cancelled();
+
 // add a new task
 void queue_async_task(AsyncTaskFuncType func, void *arg);
 
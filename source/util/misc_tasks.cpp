@@ -4,6 +4,7 @@
 #include "data_io/subscription_util.hpp"
 #include "data_io/string_resource.hpp"
 #include "system/change_setting.hpp"
+#include "youtube_parser/parser.hpp"
 #include "headers.hpp"
 
 static bool should_be_running = true;
@@ -30,6 +31,12 @@ void misc_tasks_thread_func(void *arg) {
 		} else if (request[TASK_SAVE_SUBSCRIPTION]) {
 			request[TASK_SAVE_SUBSCRIPTION] = false;
 			save_subscription();
+		} else if (request[TASK_REFRESH_VISITOR_DATA]) {
+			request[TASK_REFRESH_VISITOR_DATA] = false;
+			youtube_refresh_visitor_data();
+		} else if (request[TASK_SAVE_VISITOR_DATA]) {
+			request[TASK_SAVE_VISITOR_DATA] = false;
+			youtube_save_visitor_data();
 		} else {
 			usleep(50000);
 		}
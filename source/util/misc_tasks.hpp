@@ -5,6 +5,8 @@
 #define TASK_RELOAD_STRING_RESOURCE 2
 #define TASK_SAVE_HISTORY 3
 #define TASK_SAVE_SUBSCRIPTION 4
+#define TASK_REFRESH_VISITOR_DATA 5
+#define TASK_SAVE_VISITOR_DATA 6
 
 void misc_tasks_request(int type);
 void misc_tasks_thread_func(void *);
@@ -20,6 +20,11 @@ bool var_video_show_debug_info = false;
 int var_player_response = 1; // 0 : Android, 1 : Android VR, 2 : visionOS (interm 34.1 has 1 as for now 0 is 100% broken 1 is only broken for kids right now, stop gap hence the interm release)
 bool var_video_linear_filter = true;
 double var_forward_buffer_ratio = 0.8;
+double var_buffer_target_seconds = 60;
+double var_buffer_low_water_seconds = 20;
+int var_stream_cache_size_mb = 256; // 0 : the SD card stream cache is disabled
+int var_livestream_prefetch_fragments = 3; // livestream fragments downloaded in parallel ahead of the playback
+int var_livestream_low_latency_fragments = 0; // the target latency of livestreams in fragments, 0 : disabled
 u8 var_wifi_state = 0;
 u8 var_wifi_signal = 0;
 u8 var_battery_charge = 0;
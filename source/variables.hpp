@@ -12,7 +12,8 @@ extern bool var_history_enabled;
 extern bool var_oauth_enabled;
 extern int var_autoplay_level;
 extern int var_loop_mode;
-extern int var_video_quality;
+extern int var_video_quality; // VIDEO_QUALITY_AUTO, 0 (audio only) or the p value
+#define VIDEO_QUALITY_AUTO (-1)
 extern bool var_show_fps;
 extern bool var_full_dislike_like_count;
 extern bool var_full_screen_mode;
@@ -20,6 +21,11 @@ extern bool var_video_show_debug_info;
 extern int var_player_response;
 extern bool var_video_linear_filter;
 extern double var_forward_buffer_ratio;
+extern double var_buffer_target_seconds;
+extern double var_buffer_low_water_seconds;
+extern int var_stream_cache_size_mb;
+extern int var_livestream_prefetch_fragments;
+extern int var_livestream_low_latency_fragments;
 extern u8 var_wifi_state;
 extern u8 var_wifi_signal;
 extern u8 var_battery_charge;
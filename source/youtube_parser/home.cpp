@@ -32,7 +32,8 @@ YouTubeHomeResult youtube_load_home_page() {
 	access_and_parse_json(
 	    [&]() { return http_post_json(get_innertube_api_url("browse"), post_content, headers); },
 	    [&](Document &json_root, RJson yt_result) {
-		    res.visitor_data = yt_result["responseContext"]["visitorData"].string_value();
+		    update_visitor_data(yt_result["responseContext"]["visitorData"].string_value());
+		    res.visitor_data = get_cached_visitor_data();
 
 		    if (OAuth::is_authenticated()) {
 			    for (auto tab : yt_result["contents"]["singleColumnBrowseResultsRenderer"]["tabs"].array_items()) {
@@ -164,9 +165,8 @@ void YouTubeHomeResult::load_more_results() {
 	access_and_parse_json(
 	    [&]() { return http_post_json(get_innertube_api_url("browse"), post_content, headers); },
 	    [&](Document &json_root, RJson yt_result) {
-		    if (yt_result["responseContext"]["visitorData"].string_value() != "") {
-			    visitor_data = yt_result["responseContext"]["visitorData"].string_value();
-		    }
+		    update_visitor_data(yt_result["responseContext"]["visitorData"].string_value());
+		    visitor_data = get_cached_visitor_data();
 
 		    if (yt_result.has_key("continuationContents")) {
 			    auto section_continuation = yt_result["continuationContents"]["sectionListContinuation"];
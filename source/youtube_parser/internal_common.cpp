@@ -21,6 +21,10 @@ void youtube_change_content_language(std::string language_code) {
 	}
 }
 
+void youtube_set_cancel_token(std::shared_ptr<NetworkCancelToken> token) {
+	youtube_parser::thread_network_session_list.set_cancel_token(token);
+}
+
 namespace youtube_parser {
 std::string language_code = "en";
 std::string country_code = "US";
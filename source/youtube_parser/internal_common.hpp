@@ -43,6 +43,18 @@ std::pair<bool, std::string> http_get(const std::string &url, std::map<std::stri
 std::pair<bool, std::string> http_post_json(const std::string &url, const std::string &json,
                                             std::map<std::string, std::string> header = {});
 
+// visitor data (visitor_data.cpp)
+// the token is shared by all requests, persisted to the SD card and refreshed in the background once it gets stale
+// returns "" if no token is available yet
+std::string get_cached_visitor_data();
+// stores a token found in a response (e.g. responseContext.visitorData); empty strings are ignored
+void update_visitor_data(const std::string &visitor_data);
+#ifndef _WIN32
+HttpRequest visitor_data_request();
+// parses the response of visitor_data_request() and stores the token on success
+std::string extract_visitor_data(NetworkResult &response);
+#endif
+
 // string util
 bool starts_with(const std::string &str, const std::string &pattern, size_t offset = 0);
 bool ends_with(const std::string &str, const std::string &pattern);
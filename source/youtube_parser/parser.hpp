@@ -3,6 +3,9 @@
 #include <string>
 #include <map>
 #include <functional>
+#include <memory>
+
+struct NetworkCancelToken;
 
 struct YouTubeChannelSuccinct {
 	std::string name;
@@ -72,7 +75,9 @@ struct YouTubeVideoDetail {
 	std::string id;
 	std::string succinct_thumbnail_url;
 	std::string audio_stream_url;
+	int audio_stream_bitrate = 0;                 // bits per second, 0 if unknown
 	std::map<int, std::string> video_stream_urls; // first : video size (144p, 240p, 360p ...)
+	std::map<int, int> video_stream_bitrates;     // same keys as video_stream_urls, bits per second
 	std::string both_stream_url;
 	int duration_ms;
 	bool is_livestream;
@@ -267,6 +272,13 @@ struct YouTubeHomeResult {
 YouTubeHomeResult youtube_load_home_page();
 
 void youtube_change_content_language(std::string language_code);
+// the requests the parser sends from now on are aborted once `token` is cancelled (NULL : never aborted)
+// the loading functions then return a result with `error` set
+void youtube_set_cancel_token(std::shared_ptr<NetworkCancelToken> token);
+
+// fetches a fresh visitor data token in place of a stale one; meant to be run from the misc tasks thread
+void youtube_refresh_visitor_data();
+void youtube_save_visitor_data();
 
 /* -------------------------------- utils.cpp -------------------------------- */
 std::string youtube_get_video_id_by_url(const std::string &url);
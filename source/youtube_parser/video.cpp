@@ -34,6 +34,12 @@ static bool extract_player_data(Document &json_root, RJson player_response, YouT
 		              .c_str()); // something like %2C still appears in the url, so decode them back
 	}
 
+	// the average bitrate is what matters for the buffer, the peak one is only given as `bitrate`
+	auto get_bitrate = [](RJson format) {
+		int bitrate = format["averageBitrate"].int_value();
+		return bitrate > 0 ? bitrate : format["bitrate"].int_value();
+	};
+
 	res.stream_fragment_len = -1;
 	res.is_livestream = false;
 	std::vector<RJson> audio_formats, video_formats;
@@ -75,11 +81,13 @@ static bool extract_player_data(Document &json_root, RJson player_response, YouT
 		for (auto i : audio_formats) {
 			if (i["itag"].int_value() == 140) {
 				res.audio_stream_url = i["url"].string_value();
+				res.audio_stream_bitrate = get_bitrate(i);
 			}
 		}
 
 		if (res.audio_stream_url == "" && audio_formats.size()) {
 			res.audio_stream_url = audio_formats[0]["url"].string_value();
+			res.audio_stream_bitrate = get_bitrate(audio_formats[0]);
 		}
 	}
 	// video
@@ -101,6 +109,7 @@ static bool extract_player_data(Document &json_root, RJson player_response, YouT
 			// Store the stream URL by resolution
 			if (resolution > 0) {
 				res.video_stream_urls[resolution] = url;
+				res.video_stream_bitrates[resolution] = get_bitrate(i);
 			}
 		}
 		// both_stream_url : search for itag 18
@@ -112,37 +121,28 @@ static bool extract_player_data(Document &json_root, RJson player_response, YouT
 		}
 	}
 
-	// extract caption data
-	std::string captions_content =
-	    R"({"context": {"client": {"hl": "%0","gl": "%1","clientName": "MWEB","clientVersion": "2.20241202.07.00"}}, "videoId": "%2"})";
-	captions_content = std::regex_replace(captions_content, std::regex("%0"), language_code);
-	captions_content = std::regex_replace(captions_content, std::regex("%1"), country_code);
-	captions_content = std::regex_replace(captions_content, std::regex("%2"), res.id);
+	return true;
+}
 
-	access_and_parse_json([&]() { return http_post_json(get_innertube_api_url("player"), captions_content); },
-	                      [&](Document &, RJson mweb_data) {
-		                      RJson captions = mweb_data["captions"]["playerCaptionsTracklistRenderer"];
-
-		                      for (auto base_lang : captions["captionTracks"].array_items()) {
-			                      YouTubeVideoDetail::CaptionBaseLanguage cur_lang;
-			                      cur_lang.name = get_text_from_object(base_lang["name"]);
-			                      cur_lang.id = base_lang["languageCode"].string_value();
-			                      cur_lang.base_url = base_lang["baseUrl"].string_value();
-			                      cur_lang.is_translatable = base_lang["isTranslatable"].bool_value();
-			                      res.caption_base_languages.push_back(cur_lang);
-			                      logger.info("Caption Data", cur_lang.base_url);
-		                      }
+static void extract_caption_data(RJson mweb_player_response, YouTubeVideoDetail &res) {
+	RJson captions = mweb_player_response["captions"]["playerCaptionsTracklistRenderer"];
 
-		                      for (auto translation_lang : captions["translationLanguages"].array_items()) {
-			                      YouTubeVideoDetail::CaptionTranslationLanguage cur_lang;
-			                      cur_lang.name = get_text_from_object(translation_lang["languageName"]);
-			                      cur_lang.id = translation_lang["languageCode"].string_value();
-			                      res.caption_translation_languages.push_back(cur_lang);
-		                      }
-	                      },
-	                      [&](const std::string &error) { debug_error((res.error = "[v-cap-mweb] " + error)); });
+	for (auto base_lang : captions["captionTracks"].array_items()) {
+		YouTubeVideoDetail::CaptionBaseLanguage cur_lang;
+		cur_lang.name = get_text_from_object(base_lang["name"]);
+		cur_lang.id = base_lang["languageCode"].string_value();
+		cur_lang.base_url = base_lang["baseUrl"].string_value();
+		cur_lang.is_translatable = base_lang["isTranslatable"].bool_value();
+		res.caption_base_languages.push_back(cur_lang);
+		logger.info("Caption Data", cur_lang.base_url);
+	}
 
-	return true;
+	for (auto translation_lang : captions["translationLanguages"].array_items()) {
+		YouTubeVideoDetail::CaptionTranslationLanguage cur_lang;
+		cur_lang.name = get_text_from_object(translation_lang["languageName"]);
+		cur_lang.id = translation_lang["languageCode"].string_value();
+		res.caption_translation_languages.push_back(cur_lang);
+	}
 }
 
 static void extract_like_dislike_counts(RJson buttons, YouTubeVideoDetail &res) {
@@ -293,19 +293,18 @@ std::string format_with_commas(int number) {
 	return result;
 }
 
-void fetch_like_dislike_counts(const std::string &video_id, YouTubeVideoDetail &res) {
-	std::string api_url = "https://returnyoutubedislikeapi.com/votes?videoId=" + video_id;
-
-	std::map<std::string, std::string> headers;
-	auto response = http_get(api_url, headers);
-
-	logger.info("Raw JSON response", response.second);
+static HttpRequest like_dislike_counts_request(const std::string &video_id) {
+	return http_get_request("https://returnyoutubedislikeapi.com/votes?videoId=" + video_id);
+}
+static void extract_like_dislike_counts_ryd(NetworkResult &response, YouTubeVideoDetail &res) {
+	std::string response_str(response.data.begin(), response.data.end());
+	logger.info("Raw JSON response", response_str);
 
-	if (response.first) {
+	if (!response.fail) {
 		rapidjson::Document document;
 		std::string error;
 
-		RJson data = RJson::parse(document, response.second.c_str(), error);
+		RJson data = RJson::parse(document, response_str.c_str(), error);
 
 		if (data.is_valid()) {
 
@@ -416,8 +415,6 @@ static void extract_metadata(RJson data, YouTubeVideoDetail &res) {
 		}
 	}
 
-	fetch_like_dislike_counts(res.id, res);
-
 	RJson playlist_object = data["contents"]["singleColumnWatchNextResults"]["playlist"]["playlist"];
 	if (playlist_object.is_valid()) {
 		res.playlist.id = playlist_object["playlistId"].string_value();
@@ -483,39 +480,6 @@ static void extract_metadata(RJson data, YouTubeVideoDetail &res) {
 	}
 }
 
-static std::string extractVisitorData() {
-	std::string url = "https://www.youtube.com/sw.js_data";
-	std::map<std::string, std::string> headers = {{"Origin", "https://www.youtube.com"},
-	                                              {"Referer", "https://www.youtube.com/"}};
-	auto response = http_get(url, headers);
-
-	if (response.first) {
-		std::string json_content = response.second;
-		const std::string unwanted_prefix = ")]}'\n";
-		if (json_content.find(unwanted_prefix) == 0) {
-			json_content = json_content.substr(unwanted_prefix.size());
-		}
-
-		rapidjson::Document document;
-		std::string error;
-		RJson data = RJson::parse(document, json_content.c_str(), error);
-
-		if (data.is_valid()) {
-			std::string visitor_data = data[static_cast<size_t>(0)][static_cast<size_t>(2)][static_cast<size_t>(0)]
-			                               [static_cast<size_t>(0)][static_cast<size_t>(13)]
-			                                   .string_value();
-			logger.info("Visitor Data", "Fetched new visitor data: " + visitor_data);
-			return visitor_data;
-		} else {
-			logger.error("Visitor Data", "JSON Parsing Error: " + error);
-			return "";
-		}
-	} else {
-		logger.error("Visitor Data", "Failed to fetch visitor data");
-		return "";
-	}
-}
-
 YouTubeVideoDetail youtube_load_video_page(std::string url) {
 	YouTubeVideoDetail res;
 
@@ -528,7 +492,6 @@ YouTubeVideoDetail youtube_load_video_page(std::string url) {
 	std::string playlist_id = youtube_get_playlist_id_by_url(url);
 
 	std::string video_content;
-	std::string visitor_data = extractVisitorData();
 
 	// Use Android VR client when authenticated, regardless of var_player_response setting
 	bool use_android_vr = OAuth::is_authenticated();
@@ -562,7 +525,6 @@ YouTubeVideoDetail youtube_load_video_page(std::string url) {
 	                                   playlist_id.empty() ? "" : "\"playlistId\": \"" + playlist_id + "\", ");
 	video_content = std::regex_replace(video_content, std::regex("%2"), language_code);
 	video_content = std::regex_replace(video_content, std::regex("%3"), country_code);
-	video_content = std::regex_replace(video_content, std::regex("%4"), visitor_data);
 
 	std::string post_content;
 	if (use_android_vr) {
@@ -577,7 +539,13 @@ YouTubeVideoDetail youtube_load_video_page(std::string url) {
 	                                  playlist_id.empty() ? "" : "\"playlistId\": \"" + playlist_id + "\", ");
 	post_content = std::regex_replace(post_content, std::regex("%2"), language_code);
 	post_content = std::regex_replace(post_content, std::regex("%3"), country_code);
-	post_content = std::regex_replace(post_content, std::regex("%4"), visitor_data);
+
+	// the MWEB player response is only used for caption tracks
+	std::string captions_content =
+	    R"({"context": {"client": {"hl": "%0","gl": "%1","clientName": "MWEB","clientVersion": "2.20241202.07.00"}}, "videoId": "%2"})";
+	captions_content = std::regex_replace(captions_content, std::regex("%0"), language_code);
+	captions_content = std::regex_replace(captions_content, std::regex("%1"), country_code);
+	captions_content = std::regex_replace(captions_content, std::regex("%2"), res.id);
 
 	std::string urls[2] = {get_innertube_api_url("next"), get_innertube_api_url("player")};
 
@@ -587,15 +555,39 @@ YouTubeVideoDetail youtube_load_video_page(std::string url) {
 		debug_info("Using authenticated Android VR client");
 	}
 
+	// only the bodies containing "%4" need the visitor data; if no token is cached yet, it is fetched in the same
+	// graph so that everything else still goes out in the first batch
+	HttpRequestGraph request_graph;
+	std::string visitor_data = get_cached_visitor_data();
+	bool visitor_data_extracted = visitor_data != "";
+	int visitor_data_index = visitor_data_extracted ? -1 : request_graph.add(visitor_data_request());
+	auto add_request = [&](const std::string &url, const std::string &content) {
+		if (content.find("%4") == std::string::npos) {
+			return request_graph.add(http_post_json_request(url, content, headers));
+		}
+		if (visitor_data_extracted) {
+			return request_graph.add(
+			    http_post_json_request(url, std::regex_replace(content, std::regex("%4"), visitor_data), headers));
+		}
+		return request_graph.add({visitor_data_index}, [&, url, content](std::vector<NetworkResult> &results) {
+			if (!visitor_data_extracted) {
+				visitor_data = extract_visitor_data(results[visitor_data_index]);
+				visitor_data_extracted = true;
+			}
+			return http_post_json_request(url, std::regex_replace(content, std::regex("%4"), visitor_data), headers);
+		});
+	};
+	int request_indexes[2] = {add_request(urls[0], post_content), add_request(urls[1], video_content)};
+	int captions_index = request_graph.add(http_post_json_request(urls[1], captions_content));
+	int like_dislike_index = request_graph.add(like_dislike_counts_request(res.id));
+
 	debug_info("accessing(multi)...");
+	std::vector<NetworkResult> all_results = request_graph.perform(thread_network_session_list);
 	std::vector<NetworkResult> results;
 	bool success = true;
 	{
-		std::vector<HttpRequest> requests;
-		requests.push_back(http_post_json_request(urls[0], post_content, headers));
-		requests.push_back(http_post_json_request(urls[1], video_content, headers));
-
-		results = thread_network_session_list.perform(requests);
+		results.push_back(std::move(all_results[request_indexes[0]]));
+		results.push_back(std::move(all_results[request_indexes[1]]));
 		for (int i = 0; i < 2; i++) {
 			if (results[i].fail) {
 				res.error = "[v-#" + std::to_string(i) + "] Network request failed";
@@ -627,6 +619,18 @@ YouTubeVideoDetail youtube_load_video_page(std::string url) {
 				success = false;
 			}
 		}
+		extract_like_dislike_counts_ryd(all_results[like_dislike_index], res);
+
+		NetworkResult &captions_result = all_results[captions_index];
+		if (!captions_result.fail && !captions_result.data.empty()) {
+			captions_result.data.push_back('\0');
+			parse_json_destructive(
+			    (char *)&captions_result.data[0],
+			    [&](Document &, RJson mweb_data) { extract_caption_data(mweb_data, res); },
+			    [&](const std::string &error) { debug_error((res.error = "[v-cap-mweb] " + error)); });
+		} else if (captions_result.fail) {
+			debug_error((res.error = "[v-cap-mweb] " + captions_result.error));
+		}
 
 		// Fallback: If Android VR with auth returns UNPLAYABLE, retry with unauthenticated Android
 		if (use_android_vr && res.playability_status == "UNPLAYABLE") {
@@ -0,0 +1,125 @@
+#include <time.h>
+#include "internal_common.hpp"
+#include "system/libctru_wrapper.hpp"
+
+#define VISITOR_DATA_FILE_PATH (DEF_MAIN_DIR + "visitor_data.txt")
+#define VISITOR_DATA_TTL (12 * 60 * 60) // seconds until the token is considered stale and refreshed in the background
+
+namespace youtube_parser {
+static Mutex visitor_data_lock;
+static bool visitor_data_loaded = false; // whether the SD card copy has been read
+static bool refresh_requested = false;
+static std::string visitor_data;
+static time_t visitor_data_fetched_time = 0;
+
+// must be called with `visitor_data_lock` held
+static void confirm_visitor_data_loaded() {
+	if (visitor_data_loaded) {
+		return;
+	}
+	visitor_data_loaded = true;
+
+	char buf[0x401] = {0};
+	u32 read_size;
+	Result_with_string result = Path(VISITOR_DATA_FILE_PATH).read_file((u8 *)buf, 0x400, read_size);
+	if (result.code != 0) {
+		debug_info("visitor data not saved yet");
+		return;
+	}
+	auto data = parse_xml_like_text(buf);
+	visitor_data = data["visitor_data"];
+	visitor_data_fetched_time = strtoll(data["fetched_time"].c_str(), NULL, 10);
+	debug_info("loaded visitor data : " + visitor_data);
+}
+
+static void set_visitor_data(const std::string &new_visitor_data) {
+	visitor_data_lock.lock();
+	bool changed = visitor_data != new_visitor_data;
+	visitor_data = new_visitor_data;
+	visitor_data_fetched_time = time(NULL);
+	visitor_data_loaded = true;
+	visitor_data_lock.unlock();
+
+	if (changed) {
+		misc_tasks_request(TASK_SAVE_VISITOR_DATA);
+	}
+}
+
+std::string get_cached_visitor_data() {
+	visitor_data_lock.lock();
+	confirm_visitor_data_loaded();
+	std::string res = visitor_data;
+	if (res != "" && time(NULL) - visitor_data_fetched_time > VISITOR_DATA_TTL && !refresh_requested) {
+		refresh_requested = true;
+		misc_tasks_request(TASK_REFRESH_VISITOR_DATA);
+	}
+	visitor_data_lock.unlock();
+	return res;
+}
+void update_visitor_data(const std::string &new_visitor_data) {
+	if (new_visitor_data != "") {
+		set_visitor_data(new_visitor_data);
+	}
+}
+
+HttpRequest visitor_data_request() {
+	return HttpRequest::GET("https://www.youtube.com/sw.js_data",
+	                        {{"Origin", "https://www.youtube.com"}, {"Referer", "https://www.youtube.com/"}});
+}
+std::string extract_visitor_data(NetworkResult &response) {
+	if (!response.fail) {
+		std::string json_content(response.data.begin(), response.data.end());
+		const std::string unwanted_prefix = ")]}'\n";
+		if (json_content.find(unwanted_prefix) == 0) {
+			json_content = json_content.substr(unwanted_prefix.size());
+		}
+
+		rapidjson::Document document;
+		std::string error;
+		RJson data = RJson::parse(document, json_content.c_str(), error);
+
+		if (data.is_valid()) {
+			std::string res = data[static_cast<size_t>(0)][static_cast<size_t>(2)][static_cast<size_t>(0)]
+			                      [static_cast<size_t>(0)][static_cast<size_t>(13)]
+			                          .string_value();
+			logger.info("Visitor Data", "Fetched new visitor data: " + res);
+			update_visitor_data(res);
+			return res;
+		} else {
+			logger.error("Visitor Data", "JSON Parsing Error: " + error);
+			return "";
+		}
+	} else {
+		logger.error("Visitor Data", "Failed to fetch visitor data");
+		return "";
+	}
+}
+} // namespace youtube_parser
+
+// only called from the misc tasks thread, so it has a session list of its own
+static bool misc_network_session_list_inited = false;
+static NetworkSessionList misc_network_session_list;
+
+void youtube_refresh_visitor_data() {
+	if (!misc_network_session_list_inited) {
+		misc_network_session_list_inited = true;
+		misc_network_session_list.init();
+	}
+	auto result = misc_network_session_list.perform(visitor_data_request());
+	if (extract_visitor_data(result) == "") {
+		debug_warning("visitor data refresh failed, keeping the old one");
+	}
+
+	visitor_data_lock.lock();
+	refresh_requested = false;
+	visitor_data_lock.unlock();
+}
+void youtube_save_visitor_data() {
+	visitor_data_lock.lock();
+	std::string data = "<visitor_data>" + visitor_data + "</visitor_data>\n<fetched_time>" +
+	                   std::to_string((long long)visitor_data_fetched_time) + "</fetched_time>\n";
+	visitor_data_lock.unlock();
+
+	Result_with_string result = Path(VISITOR_DATA_FILE_PATH).write_file((u8 *)data.c_str(), data.size());
+	logger.info("visitor/save", "write_file()..." + result.string + result.error_description, result.code);
+}
@@ -0,0 +1,32 @@
+#pragma once
+// portable emulation of the ARMv6 SIMD (SIMD32) ACLE intrinsics used by network_decoder/yuv_tiled.c, so that the
+// SIMD kernel can be compared with the reference on a host
+// yuv_tiled_test builds yuv_tiled.c with -D__ARM_FEATURE_SIMD32 and this directory on the include path
+#include <stdint.h>
+
+typedef int32_t int16x2_t;
+typedef uint32_t uint16x2_t;
+
+static inline int16_t acle_emu_lane(uint32_t x, int i) { return (int16_t)(x >> (16 * i)); }
+static inline uint32_t acle_emu_pack(int low, int high) { return (uint16_t)low | (uint32_t)(uint16_t)high << 16; }
+static inline int acle_emu_sat(int x, int min, int max) { return x < min ? min : x > max ? max : x; }
+
+// zero-extends bytes 0 and 2 into the two halfwords
+static inline uint16x2_t __uxtb16(uint32_t x) { return x & 0x00FF00FF; }
+
+// halfword-wise subtraction, wrapping
+static inline int16x2_t __ssub16(int16x2_t a, int16x2_t b) {
+	return (int16x2_t)acle_emu_pack(acle_emu_lane(a, 0) - acle_emu_lane(b, 0), acle_emu_lane(a, 1) - acle_emu_lane(b, 1));
+}
+
+// halfword-wise addition, saturated to the signed 16-bit range
+static inline int16x2_t __qadd16(int16x2_t a, int16x2_t b) {
+	return (int16x2_t)acle_emu_pack(acle_emu_sat(acle_emu_lane(a, 0) + acle_emu_lane(b, 0), -32768, 32767),
+	                                acle_emu_sat(acle_emu_lane(a, 1) + acle_emu_lane(b, 1), -32768, 32767));
+}
+
+// each signed halfword saturated to the unsigned range [0, 2^bits - 1]
+static inline uint16x2_t __usat16(int16x2_t x, int bits) {
+	int max = (1 << bits) - 1;
+	return acle_emu_pack(acle_emu_sat(acle_emu_lane(x, 0), 0, max), acle_emu_sat(acle_emu_lane(x, 1), 0, max));
+}
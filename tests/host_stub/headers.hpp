@@ -0,0 +1,21 @@
+#pragma once
+// stands in for source/headers.hpp when a source file of the app is built on a host by the tests
+// only what those files use is provided
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+
+struct HostLogger {
+	void error(const std::string &tag, const std::string &message) {
+		fprintf(stderr, "[%s] %s\n", tag.c_str(), message.c_str());
+	}
+};
+static HostLogger logger;
@@ -0,0 +1,66 @@
+// Image_decode() and Image_decode_rgba8() against the RGB888 output of stb_image they pack
+#include "network_decoder/image.cpp"
+
+static std::vector<u8> read_file(const char *path) {
+	std::vector<u8> res;
+	FILE *fp = fopen(path, "rb");
+	if (!fp) {
+		return res;
+	}
+	u8 buf[4096];
+	size_t size;
+	while ((size = fread(buf, 1, sizeof(buf), fp)) > 0) {
+		res.insert(res.end(), buf, buf + size);
+	}
+	fclose(fp);
+	return res;
+}
+
+static bool check(const char *path) {
+	std::vector<u8> data = read_file(path);
+	int full_w, full_h, comp;
+	u8 *full = data.size() ? stbi_load_from_memory(data.data(), data.size(), &full_w, &full_h, &comp, 3) : NULL;
+	if (!full) {
+		printf("%s : failed to load\n", path);
+		return false;
+	}
+	bool ok = true;
+	int w = 0, h = 0;
+	u32 *rgba8 = (u32 *)Image_decode_rgba8(data.data(), data.size(), &w, &h);
+	if (!rgba8 || w != full_w || h != full_h) {
+		printf("%s RGBA8 : got %dx%d, expected %dx%d\n", path, w, h, full_w, full_h);
+		ok = false;
+	}
+	for (int i = 0; ok && i < w * h; i++) {
+		u32 expected = (u32)full[i * 3] << 24 | (u32)full[i * 3 + 1] << 16 | (u32)full[i * 3 + 2] << 8 | 0xFF;
+		if (rgba8[i] != expected) {
+			printf("%s RGBA8 : differs at pixel %d\n", path, i);
+			ok = false;
+		}
+	}
+	u16 *bgr565 = (u16 *)Image_decode(data.data(), data.size(), &w, &h);
+	if (!bgr565 || w != full_w || h != full_h) {
+		printf("%s BGR565 : got %dx%d, expected %dx%d\n", path, w, h, full_w, full_h);
+		ok = false;
+	}
+	for (int i = 0; ok && i < w * h; i++) {
+		u16 expected = (full[i * 3] & 0xF8) << 8 | (full[i * 3 + 1] & 0xFC) << 3 | full[i * 3 + 2] >> 3;
+		if (bgr565[i] != expected) {
+			printf("%s BGR565 : differs at pixel %d\n", path, i);
+			ok = false;
+		}
+	}
+	free(bgr565);
+	free(rgba8);
+	stbi_image_free(full);
+	return ok;
+}
+
+int main(int argc, char **argv) {
+	int failed = 0;
+	for (int i = 1; i < argc; i++) {
+		failed += !check(argv[i]);
+	}
+	printf("image_decode : %d / %d passed\n", argc - 1 - failed, argc - 1);
+	return failed != 0;
+}
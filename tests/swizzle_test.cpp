@@ -0,0 +1,188 @@
+// swizzle_to_texture<>() against the implementation of Draw_set_texture_data() it replaced
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "ui/draw/swizzle.hpp"
+
+typedef uint8_t u8;
+
+// ---- the previous implementation, as it was in draw.cpp (texture output only) ----
+
+// memcpy_asm_4b() in yuv_converter.s : a 4-byte load and store, called as an external function
+__attribute__((noinline)) static void memcpy_asm_4b(u8 *dst, u8 *src) { memcpy(dst, src, 4); }
+
+static int Draw_convert_to_pos(int height, int width, int img_height, int img_width, int pixel_size) {
+	int pos = img_width * height;
+	if (pos == 0) {
+		pos = img_width;
+	}
+
+	pos -= (img_width - width) - img_width;
+	return pos * pixel_size;
+}
+
+static void old_set_texture_data(u8 *tex, u8 *buf, int pic_width, int pic_height, int parse_start_width,
+                                 int parse_start_height, int tex_size_x, int tex_size_y, int pixel_size) {
+	int x_max = 0;
+	int y_max = 0;
+	std::vector<int> increase_list_x(tex_size_x + 8);
+	std::vector<int> increase_list_y(tex_size_y + 8);
+	int count[2] = {0, 0};
+	int c3d_pos = 0;
+	int c3d_offset = 0;
+
+	for (int i = 0; i <= tex_size_x; i += 4) {
+		increase_list_x[i] = 4 * pixel_size;
+		increase_list_x[i + 1] = 12 * pixel_size;
+		increase_list_x[i + 2] = 4 * pixel_size;
+		increase_list_x[i + 3] = 44 * pixel_size;
+	}
+	for (int i = 0; i <= tex_size_y; i += 8) {
+		increase_list_y[i] = 2 * pixel_size;
+		increase_list_y[i + 1] = 6 * pixel_size;
+		increase_list_y[i + 2] = 2 * pixel_size;
+		increase_list_y[i + 3] = 22 * pixel_size;
+		increase_list_y[i + 4] = 2 * pixel_size;
+		increase_list_y[i + 5] = 6 * pixel_size;
+		increase_list_y[i + 6] = 2 * pixel_size;
+		increase_list_y[i + 7] = (tex_size_x * 8 - 42) * pixel_size;
+	}
+
+	y_max = std::min(pic_height - parse_start_height, tex_size_y);
+	x_max = std::min(pic_width - parse_start_width, tex_size_x);
+
+	for (int k = 0; k < y_max; k++) {
+		for (int i = 0; i < x_max; i += 2) {
+			int src = Draw_convert_to_pos(k + parse_start_height, i + parse_start_width, pic_height, pic_width,
+			                              pixel_size);
+			memcpy_asm_4b(&tex[c3d_pos + c3d_offset], &buf[src]);
+			if (pixel_size == 3) {
+				memcpy(&tex[c3d_pos + c3d_offset + 4], &buf[src + 4], 2);
+			} else if (pixel_size == 4) {
+				memcpy_asm_4b(&tex[c3d_pos + c3d_offset + 4], &buf[src + 4]);
+			}
+			c3d_pos += increase_list_x[count[0]];
+			count[0]++;
+		}
+		count[0] = 0;
+		c3d_pos = 0;
+		c3d_offset += increase_list_y[count[1]];
+		count[1]++;
+	}
+}
+
+// ---- the new implementation, as called by Draw_set_texture_data() ----
+
+static void new_set_texture_data(u8 *tex, u8 *buf, int pic_width, int pic_height, int parse_start_width,
+                                 int parse_start_height, int tex_size_x, int tex_size_y, int pixel_size) {
+	int y_max = std::min(pic_height - parse_start_height, tex_size_y);
+	int x_max = std::min(pic_width - parse_start_width, tex_size_x);
+	u8 *src = buf + (parse_start_height * pic_width + parse_start_width) * pixel_size;
+	int src_stride = pic_width * pixel_size;
+	if (pixel_size == 2) {
+		swizzle_to_texture<2>(tex, src, src_stride, x_max, y_max, tex_size_x);
+	} else if (pixel_size == 3) {
+		swizzle_to_texture<3>(tex, src, src_stride, x_max, y_max, tex_size_x);
+	} else if (pixel_size == 4) {
+		swizzle_to_texture<4>(tex, src, src_stride, x_max, y_max, tex_size_x);
+	}
+}
+
+static int tex_pos(int x, int y, int tex_size_x) {
+	int tile = y / 8 * (tex_size_x / 8) + x / 8;
+	int morton = (x & 1) | (y & 1) << 1 | (x & 2) << 1 | (y & 2) << 2 | (x & 4) << 2 | (y & 4) << 3;
+	return tile * 64 + morton;
+}
+
+struct Case {
+	int pic_width, pic_height, parse_start_width, parse_start_height, tex_size_x, tex_size_y;
+};
+
+// the old implementation read image row 1 for texture row 0 when starting from the top of the image, so the two
+// outputs are compared on the other rows, and texture row 0 is checked against the image itself
+static bool check(const Case &c, int pixel_size) {
+	int x_max = std::min(c.pic_width - c.parse_start_width, c.tex_size_x);
+	int y_max = std::min(c.pic_height - c.parse_start_height, c.tex_size_y);
+	// the old implementation copies pixel pairs and may read one pixel past the end
+	std::vector<u8> buf(c.pic_width * (c.pic_height + 1) * pixel_size + 8);
+	for (size_t i = 0; i < buf.size(); i++) {
+		buf[i] = rand();
+	}
+	std::vector<u8> old_tex(c.tex_size_x * c.tex_size_y * pixel_size + 64 * 4, 0);
+	std::vector<u8> new_tex(old_tex.size(), 0);
+	old_set_texture_data(old_tex.data(), buf.data(), c.pic_width, c.pic_height, c.parse_start_width,
+	                     c.parse_start_height, c.tex_size_x, c.tex_size_y, pixel_size);
+	new_set_texture_data(new_tex.data(), buf.data(), c.pic_width, c.pic_height, c.parse_start_width,
+	                     c.parse_start_height, c.tex_size_x, c.tex_size_y, pixel_size);
+
+	for (int y = 0; y < y_max; y++) {
+		for (int x = 0; x < x_max; x++) {
+			int pos = tex_pos(x, y, c.tex_size_x) * pixel_size;
+			const u8 *expected = &old_tex[pos];
+			if (y == 0 && c.parse_start_height == 0) {
+				expected = &buf[(c.parse_start_width + x) * pixel_size];
+			}
+			if (memcmp(&new_tex[pos], expected, pixel_size)) {
+				printf("mismatch : %dx%d from (%d, %d) into %dx%d, %d bytes per pixel, at (%d, %d)\n", c.pic_width,
+				       c.pic_height, c.parse_start_width, c.parse_start_height, c.tex_size_x, c.tex_size_y,
+				       pixel_size, x, y);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static double time_ms(void (*func)(u8 *, u8 *, int, int, int, int, int, int, int), const Case &c, int pixel_size,
+                      int repeat) {
+	std::vector<u8> buf(c.pic_width * (c.pic_height + 1) * pixel_size + 8, 0x55);
+	std::vector<u8> tex(c.tex_size_x * c.tex_size_y * pixel_size, 0);
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < repeat; i++) {
+		func(tex.data(), buf.data(), c.pic_width, c.pic_height, c.parse_start_width, c.parse_start_height,
+		     c.tex_size_x, c.tex_size_y, pixel_size);
+	}
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count() / repeat;
+}
+
+int main(int argc, char **argv) {
+	bool bench = argc > 1 && !strcmp(argv[1], "--bench");
+	const Case cases[] = {
+	    {8, 8, 0, 0, 8, 8},           {16, 16, 0, 0, 16, 16},       {120, 67, 0, 0, 128, 128},
+	    {88, 88, 0, 0, 128, 128},     {33, 17, 0, 0, 64, 32},       {31, 9, 0, 0, 32, 16},
+	    {400, 240, 0, 0, 512, 256},   {1060, 300, 18, 0, 1024, 512}, {100, 80, 3, 5, 128, 128},
+	    {100, 80, 0, 7, 64, 64},      {300, 200, 50, 40, 256, 256}, {13, 11, 1, 1, 16, 16},
+	    {640, 360, 0, 0, 512, 256},   {2, 2, 0, 0, 8, 8},
+	};
+	const int pixel_sizes[] = {2, 3, 4}; // GPU_RGB565, GPU_RGB8, GPU_RGBA8
+
+	srand(0);
+	int failed = 0, total = 0;
+	for (auto &c : cases) {
+		for (int pixel_size : pixel_sizes) {
+			total++;
+			failed += !check(c, pixel_size);
+		}
+	}
+	printf("swizzle : %d / %d passed\n", total - failed, total);
+	if (failed) {
+		return 1;
+	}
+
+	if (bench) {
+		const Case bench_cases[] = {{120, 67, 0, 0, 128, 128}, {400, 240, 0, 0, 512, 256}, {1024, 512, 0, 0, 1024, 512}};
+		for (auto &c : bench_cases) {
+			for (int pixel_size : pixel_sizes) {
+				int repeat = std::max(1, 20000000 / (c.pic_width * c.pic_height));
+				double old_ms = time_ms(old_set_texture_data, c, pixel_size, repeat);
+				double new_ms = time_ms(new_set_texture_data, c, pixel_size, repeat);
+				printf("%4dx%-4d %d bytes per pixel : old %.3f ms, new %.3f ms (x%.2f)\n", c.pic_width, c.pic_height,
+				       pixel_size, old_ms, new_ms, old_ms / new_ms);
+			}
+		}
+	}
+	return 0;
+}
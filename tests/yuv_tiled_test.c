@@ -0,0 +1,74 @@
+// the ARMv6 SIMD kernel of yuv_tiled.c against its portable reference, with the intrinsics emulated (arm_acle_emu/)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "network_decoder/yuv_tiled.h"
+
+struct Case {
+	int width, height;     // frame size
+	int y_line_size;       // >= width rounded up to 8, as padded by the decoder
+	int uv_line_size;
+	int tex_width, tex_height;
+};
+
+static int check(const struct Case *c) {
+	// the planes must cover the size rounded up to 8
+	int rows = (c->height + 7) / 8 * 8;
+	size_t y_size = (size_t)c->y_line_size * rows;
+	size_t uv_size = (size_t)c->uv_line_size * (rows / 2);
+	uint8_t *y = malloc(y_size), *u = malloc(uv_size), *v = malloc(uv_size);
+	size_t tex_size = (size_t)c->tex_width * c->tex_height;
+	uint16_t *ref = malloc(tex_size * 2), *simd = malloc(tex_size * 2);
+	int res = 1;
+
+	for (size_t i = 0; i < y_size; i++) {
+		y[i] = rand();
+	}
+	for (size_t i = 0; i < uv_size; i++) {
+		u[i] = rand();
+		v[i] = rand();
+	}
+	// the extremes, where the clipping and the saturation matter
+	memset(y, 0, c->y_line_size);
+	memset(y + c->y_line_size, 255, c->y_line_size);
+	memset(u, 0, c->uv_line_size / 2);
+	memset(v, 255, c->uv_line_size / 2);
+
+	memset(ref, 0xAA, tex_size * 2);
+	memset(simd, 0xAA, tex_size * 2);
+	yuv420p_to_bgr565_tiled_ref(y, u, v, c->y_line_size, c->uv_line_size, ref, c->width, c->height, c->tex_width,
+	                            c->tex_height);
+	yuv420p_to_bgr565_tiled(y, u, v, c->y_line_size, c->uv_line_size, simd, c->width, c->height, c->tex_width,
+	                        c->tex_height);
+	for (size_t i = 0; i < tex_size; i++) {
+		if (ref[i] != simd[i]) {
+			printf("mismatch : %dx%d (line sizes %d, %d) into %dx%d, texel %zu : %04x != %04x\n", c->width,
+			       c->height, c->y_line_size, c->uv_line_size, c->tex_width, c->tex_height, i, simd[i], ref[i]);
+			res = 0;
+			break;
+		}
+	}
+	free(y);
+	free(u);
+	free(v);
+	free(ref);
+	free(simd);
+	return res;
+}
+
+int main(void) {
+	const struct Case cases[] = {
+	    {8, 8, 8, 4, 8, 8},              {256, 144, 256, 128, 256, 256},  {426, 240, 448, 224, 512, 256},
+	    {640, 360, 704, 352, 1024, 512}, {854, 480, 896, 448, 1024, 512}, {1280, 720, 1280, 640, 1024, 512},
+	    {120, 90, 128, 64, 128, 128},    {200, 100, 256, 160, 256, 128},  {64, 64, 64, 32, 32, 32},
+	};
+	int total = sizeof(cases) / sizeof(cases[0]);
+	int failed = 0;
+
+	srand(0);
+	for (int i = 0; i < total; i++) {
+		failed += !check(&cases[i]);
+	}
+	printf("yuv_tiled : %d / %d passed\n", total - failed, total);
+	return failed != 0;
+}